@@ -24,6 +24,7 @@ public:
 
 	bool pollEvents() override;
 	bool waitEvents() override;
+	using AppContext::waitEvents;
 	void wakeupWait() override;
 
 	bool clipboard(std::unique_ptr<DataSource>&&) override { return false; }
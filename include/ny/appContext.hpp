@@ -6,10 +6,14 @@
 
 #include <ny/fwd.hpp>
 #include <nytl/nonCopyable.hpp> // nytl::NonCopyable
+#include <nytl/connection.hpp> // nytl::Connection
 
 #include <memory> // std::unique_ptr
 #include <vector> // std::vector
 #include <functional> // std::function
+#include <chrono> // std::chrono::steady_clock
+#include <stdexcept> // std::logic_error
+#include <atomic> // std::atomic
 
 namespace ny {
 
@@ -29,7 +33,7 @@ using AppContextPtr = std::unique_ptr<AppContext>;
 class AppContext : public nytl::NonCopyable {
 public:
 	AppContext() = default;
-	virtual ~AppContext() = default;
+	virtual ~AppContext();
 
 	/// Creates a WindowContext implementation for the given settings.
 	/// May throw backend specific errors on failure.
@@ -82,6 +86,30 @@ public:
 	/// is supposed to exit.
 	virtual bool waitEvents() = 0;
 
+	/// Like waitEvents but returns at the latest when the given deadline is reached,
+	/// even if no events were dispatched.
+	/// Backends without support for it just poll events.
+	virtual bool waitEvents(std::chrono::steady_clock::time_point deadline)
+	{
+		(void) deadline;
+		return pollEvents();
+	}
+
+	/// Calls the given function from within a dispatch function (pollEvents or
+	/// waitEvents) when the given duration has passed. If repeat is true, it is
+	/// called in that interval until the returned connection is disconnected.
+	/// Timers that are due within a small slack window are triggered together
+	/// to reduce the number of wakeups.
+	/// Throws std::logic_error if the backend does not support timers.
+	virtual nytl::Connection addTimer(std::chrono::steady_clock::duration duration,
+			bool repeat, std::function<void()> callback)
+	{
+		(void) duration;
+		(void) repeat;
+		(void) callback;
+		throw std::logic_error("ny::AppContext::addTimer: not supported by the backend");
+	}
+
 	/// Causes waitEvents to return even if no events could be dispatched.
 	/// If waitEvents was called multiple times from within each other,
 	/// will only make the top most wait call return.
@@ -89,6 +117,13 @@ public:
 	/// be used.
 	virtual void wakeupWait() = 0;
 
+	/// Queues the given function to be called from within the next pollEvents or
+	/// waitEvents call, i.e. from the thread dispatching the events.
+	/// Can be called from any thread, the queue is lock-free. Calls wakeupWait if
+	/// the queue was empty before, so posting in a burst only wakes up once.
+	/// Functions that are not called until the AppContext is destroyed are discarded.
+	void post(std::function<void()> func);
+
 	/// Sets the clipboard to the data provided by the given DataSource implementation.
 	/// \param dataSource a DataSource implementation for the data to copy.
 	/// The data may be directly copied from the DataSource and the given object be destroyed,
@@ -133,6 +168,17 @@ public:
 	/// The returned GlSetup can be used to retrieve the different gl configs and to create
 	/// opengl contexts.
 	virtual GlSetup* glSetup() const = 0;
+
+protected:
+	/// Calls all functions queued with post so far (in the order they were posted).
+	/// Must be called by the backends from pollEvents and waitEvents.
+	/// Forwards exceptions, the remaining functions are called by the next call then.
+	void dispatchPosted();
+
+private:
+	struct PostedTask;
+	std::atomic<PostedTask*> posted_ {}; // lock-free stack of posted tasks, newest first
+	PostedTask* unfinished_ {}; // remaining tasks when one threw, oldest first
 };
 
 } // namespace nytl
@@ -7,6 +7,10 @@
 #include <ny/fwd.hpp>
 #include <ny/image.hpp> // ny::MutableImage
 #include <nytl/nonCopyable.hpp> // nytl::NonCopyable
+#include <nytl/rect.hpp> // nytl::Rect2ui
+
+#include <algorithm> // std::min, std::max
+#include <vector> // std::vector
 
 namespace ny {
 
@@ -51,7 +55,8 @@ protected:
 /// e.g. when wrapped in a smart pointer.
 class BufferGuard : public nytl::NonCopyable {
 public:
-	BufferGuard(BufferSurface& surf, const MutableImage& img) : surface_(surf), img_(img) {}
+	BufferGuard(BufferSurface& surf, const MutableImage& img, unsigned int age = 0)
+		: surface_(surf), img_(img), age_(age) {}
 	~BufferGuard() { surface_.apply(*this); }
 
 	BufferGuard(BufferGuard&&) noexcept = default;
@@ -68,15 +73,76 @@ public:
 	/// \sa BufferSurface
 	const MutableImage& get() const & { return img_; }
 
+	/// Returns the age of the buffer contents, with the same meaning as
+	/// EGL_EXT_buffer_age: 0 means the contents are undefined, N means the buffer
+	/// holds the frame that was presented N presents ago (1 for the last frame).
+	/// Together with the damage of the last frames, this can be used to only
+	/// redraw the regions that changed since this buffer was presented.
+	/// \sa damage
+	unsigned int age() const { return age_; }
+
 	/// Returns the BufferSurface associated with this BufferGuard.
 	/// The BufferGuard was retrieved from the BufferSurface and will call
 	/// BufferSurface::apply on destruction.
 	/// \sa BufferSurface
 	BufferSurface& bufferSurface() const & { return surface_; }
 
+	/// Marks the given rectangle (in buffer pixels) as changed.
+	/// If no damage is added, the whole buffer is treated as changed (default).
+	/// Otherwise backends may only upload and present the damaged regions, which
+	/// avoids uploading and recomposing the whole window for small changes.
+	/// The contents of the buffer outside the damaged regions must nevertheless
+	/// be valid since backends are free to present the whole buffer.
+	/// The rectangle is clipped to the buffer. When more than maxDamageRects
+	/// rectangles are added, they are merged into their bounding box.
+	void damage(const nytl::Rect2ui& rect) {
+		fullDamage_ = false;
+
+		nytl::Rect2ui clipped;
+		for(auto i = 0u; i < 2u; ++i) {
+			auto end = std::min<std::uint64_t>(std::uint64_t(rect.position[i]) + rect.size[i],
+				img_.size[i]);
+			clipped.position[i] = std::min(rect.position[i], img_.size[i]);
+			clipped.size[i] = end - clipped.position[i];
+		}
+
+		if(!clipped.size[0] || !clipped.size[1]) {
+			return;
+		}
+
+		damage_.push_back(clipped);
+		if(damage_.size() > maxDamageRects) {
+			auto bounds = damage_[0];
+			for(auto& r : damage_) {
+				for(auto i = 0u; i < 2u; ++i) {
+					auto end = std::max(bounds.position[i] + bounds.size[i],
+						r.position[i] + r.size[i]);
+					bounds.position[i] = std::min(bounds.position[i], r.position[i]);
+					bounds.size[i] = end - bounds.position[i];
+				}
+			}
+
+			damage_ = {bounds};
+		}
+	}
+
+	/// Returns whether the whole buffer should be treated as damaged, i.e.
+	/// whether no damage was added.
+	bool fullDamage() const { return fullDamage_; }
+
+	/// Returns the damaged regions of the buffer, clipped to its size.
+	/// Only relevant if fullDamage() returns false.
+	const std::vector<nytl::Rect2ui>& damage() const { return damage_; }
+
+public:
+	static constexpr auto maxDamageRects = 16u;
+
 protected:
 	BufferSurface& surface_;
 	MutableImage img_;
+	std::vector<nytl::Rect2ui> damage_;
+	bool fullDamage_ {true};
+	unsigned int age_ {};
 };
 
 } // namespace ny
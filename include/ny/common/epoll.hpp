@@ -0,0 +1,111 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <nytl/connection.hpp> // nytl::Connection
+#include <nytl/nonCopyable.hpp> // nytl::NonMovable
+
+#include <functional> // std::function
+#include <chrono> // std::chrono::steady_clock
+#include <list> // std::list
+
+namespace ny {
+
+/// Dispatches callbacks for file descriptors using one persistent epoll instance.
+/// Used by the unix backends to multiplex their display connection with custom fds.
+/// Callbacks are registered for poll events (POLLIN, POLLOUT, ...), EPOLLET can be
+/// added to the events to make them edge-triggered. The epoll set is only changed
+/// when callbacks are added or disconnected, dispatching does not allocate and
+/// only touches the ready callbacks. Every callback is registered for a duplicate
+/// of its fd owned by the loop, so multiple callbacks can be registered for the same
+/// fd. Callbacks must be disconnected before their fd is closed, until then they
+/// are still triggered for the underlying file.
+class EpollLoop : public nytl::NonMovable, public nytl::Connectable {
+public:
+	/// Should return false if the callback wants to be disconnected.
+	using Callback = std::function<bool(int fd, unsigned int events)>;
+
+public:
+	/// Throws std::runtime_error if the epoll instance could not be created.
+	EpollLoop();
+	~EpollLoop();
+
+	/// Registers a callback for the given fd and events.
+	/// Throws std::runtime_error if the fd could not be added to the epoll instance.
+	nytl::Connection add(int fd, unsigned int events, const Callback& callback);
+	bool disconnect(const nytl::ConnectionID& id) override;
+
+	/// Waits at most timeout milliseconds (-1 for infinite) until one of the
+	/// registered fds is ready and triggers the matching callbacks.
+	/// Callbacks may add or disconnect callbacks. Returns the number of ready
+	/// fds or -1 on error.
+	int dispatch(int timeout);
+
+	/// The epoll fd. Can itself be polled to check whether dispatch would block.
+	int fd() const { return fd_; }
+
+protected:
+	struct Entry {
+		int fd; // the fd passed to the callback
+		int registered; // the fd registered in the epoll set, an owned duplicate of fd
+		unsigned int events;
+		Callback callback;
+		nytl::ConnectionID id;
+		bool removed; // disconnected while dispatching, erased afterwards
+	};
+
+	int fd_ {-1};
+	std::list<Entry> entries_; // stable, the epoll set stores pointers to them
+	nytl::ConnectionID highestID_ {};
+	unsigned int dispatching_ {}; // depth of (nested) dispatch calls
+	bool removed_ {}; // whether there are removed entries to erase
+};
+
+/// Timers on one timerfd that is dispatched by an EpollLoop.
+/// Used by the unix backends to implement AppContext::addTimer.
+/// The timerfd is armed for the first due timer, delayed by at most
+/// slack to trigger other timers that are due shortly after it together.
+class TimerQueue : public nytl::NonMovable, public nytl::Connectable {
+public:
+	using Clock = std::chrono::steady_clock;
+	using Callback = std::function<void()>;
+	static constexpr auto slack = std::chrono::milliseconds(1);
+
+public:
+	/// Throws std::runtime_error if the timerfd could not be created.
+	TimerQueue(EpollLoop& loop);
+	~TimerQueue();
+
+	/// Adds a timer that triggers after the given duration and, if repeat is
+	/// true, in that interval afterwards. Throws std::logic_error for
+	/// repeating timers without positive interval.
+	nytl::Connection add(Clock::duration duration, bool repeat, const Callback& callback);
+	bool disconnect(const nytl::ConnectionID& id) override;
+
+protected:
+	struct Timer {
+		Clock::time_point due;
+		Clock::duration interval;
+		bool repeat;
+		Callback callback;
+		nytl::ConnectionID id;
+		bool removed; // disconnected or triggered while dispatching, erased afterwards
+	};
+
+	void dispatch(); // triggers all due timers
+	void arm(); // arms the timerfd for the next due timers
+
+	int fd_ {-1};
+	std::list<Timer> timers_;
+	nytl::ConnectionID highestID_ {};
+	unsigned int dispatching_ {}; // depth of (nested) dispatch calls
+	bool removed_ {}; // whether there are removed timers to erase
+};
+
+/// Returns the timeout in milliseconds (as used by epoll or poll) until the
+/// given deadline. Rounds up so that waiting with it does not return early.
+int timeout(std::chrono::steady_clock::time_point deadline);
+
+} // namespace ny
@@ -6,6 +6,7 @@
 
 #include <ny/fwd.hpp>
 #include <string_view>
+#include <cstddef>
 
 namespace ny {
 
@@ -24,4 +25,10 @@ Keycode linuxToKey(unsigned int keycode);
 unsigned int buttonToLinux(MouseButton);
 MouseButton linuxToButton(unsigned int buttoncode);
 
+// Creates an anonymous memory file (memfd) of the given size, e.g. to share buffers
+// with the display server. The file is close-on-exec and sealed against shrinking, so
+// a mapping of it can never be truncated under the server. It may still grow.
+// Returns -1 if memfd is not supported or the file could not be created.
+int createMemfd(const char* name, std::size_t size);
+
 } // namespace ny
@@ -0,0 +1,433 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <ny/image.hpp> // ny::ImageFormat, ny::BasicImage
+#include <nytl/vec.hpp> // nytl::Vec
+
+#include <array> // std::array
+#include <cstdint> // std::uint32_t
+#include <cstring> // std::memcpy
+#include <type_traits> // std::is_invocable_v
+#include <utility> // std::forward
+
+// Compile-time descriptions of the ImageFormat values and typed pixel access built
+// upon them. Generic image algorithms can be written once against FormatTraits and
+// then be instantiated for every format, so that the per-pixel code contains no
+// format switches. visitFormat is used to select the instantiation at runtime.
+
+namespace ny {
+namespace detail {
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	constexpr auto nativeLittleEndian = false;
+#else
+	constexpr auto nativeLittleEndian = true;
+#endif
+
+struct FormatDescription {
+	unsigned int bits; // size of one pixel
+	std::array<int, 4> shifts; // word-order bit shifts of r, g, b, a. -1 if not present
+	std::array<unsigned int, 4> depths; // number of bits of r, g, b, a
+	ImageFormat reversed; // format with reversed channel order, none if there is none
+	bool halfFloat {}; // whether the channels are 16-bit floats instead of unorm values
+};
+
+// NOTE: this is the single place describing the layout of a format.
+// a1 is described as an 8-bit alpha word with the values 0 or 255,
+// see FormatTraits::load. Unused (x) bits are not described at all.
+constexpr FormatDescription describe(ImageFormat format)
+{
+	using Format = ImageFormat;
+	switch(format) {
+		case Format::rgba8888: return {32, {24, 16, 8, 0}, {8, 8, 8, 8}, Format::abgr8888};
+		case Format::argb8888: return {32, {16, 8, 0, 24}, {8, 8, 8, 8}, Format::bgra8888};
+		case Format::abgr8888: return {32, {0, 8, 16, 24}, {8, 8, 8, 8}, Format::rgba8888};
+		case Format::bgra8888: return {32, {8, 16, 24, 0}, {8, 8, 8, 8}, Format::argb8888};
+		case Format::rgb888: return {24, {16, 8, 0, -1}, {8, 8, 8, 0}, Format::bgr888};
+		case Format::bgr888: return {24, {0, 8, 16, -1}, {8, 8, 8, 0}, Format::rgb888};
+		case Format::a8: return {8, {-1, -1, -1, 0}, {0, 0, 0, 8}, Format::a8};
+		case Format::a1: return {1, {-1, -1, -1, 0}, {0, 0, 0, 8}, Format::a1};
+		case Format::xrgb8888: return {32, {16, 8, 0, -1}, {8, 8, 8, 0}, Format::none};
+		case Format::xbgr8888: return {32, {0, 8, 16, -1}, {8, 8, 8, 0}, Format::none};
+		case Format::rgb565: return {16, {11, 5, 0, -1}, {5, 6, 5, 0}, Format::none};
+		case Format::xrgb2101010:
+			return {32, {20, 10, 0, -1}, {10, 10, 10, 0}, Format::none};
+		case Format::rgba16f:
+			return {64, {48, 32, 16, 0}, {16, 16, 16, 16}, Format::none, true};
+		case Format::none: break;
+	}
+
+	return {0, {-1, -1, -1, -1}, {0, 0, 0, 0}, Format::none};
+}
+
+// Whether every channel of the format is exactly one byte in memory.
+constexpr bool byteChannels(const FormatDescription& desc)
+{
+	if(desc.halfFloat || desc.bits % 8 != 0) {
+		return false;
+	}
+
+	for(auto c = 0u; c < 4u; ++c) {
+		if(desc.shifts[c] >= 0 && (desc.depths[c] != 8 || desc.shifts[c] % 8 != 0)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Converts between an unorm channel value of the given depth and 8 bits.
+// Rounds to the nearest value.
+constexpr unsigned int toUnorm8(unsigned int value, unsigned int depth)
+{
+	if(depth == 8) return value;
+	auto max = (1u << depth) - 1;
+	return (value * 255u + max / 2) / max;
+}
+
+constexpr unsigned int fromUnorm8(unsigned int value, unsigned int depth)
+{
+	if(depth == 8) return value;
+	auto max = (1u << depth) - 1;
+	return (value * max + 127u) / 255u;
+}
+
+// Converts between 16-bit (half) and 32-bit floats.
+// Rounds to the nearest value (ties to even).
+inline float halfToFloat(std::uint16_t half)
+{
+	std::uint32_t sign = (half & 0x8000u) << 16;
+	std::uint32_t exp = (half >> 10) & 0x1Fu;
+	std::uint32_t mant = half & 0x3FFu;
+
+	std::uint32_t bits;
+	if(exp == 0x1Fu) { // inf, nan
+		bits = sign | 0x7F800000u | (mant << 13);
+	} else if(exp) { // normal
+		bits = sign | ((exp + 112u) << 23) | (mant << 13);
+	} else if(!mant) { // zero
+		bits = sign;
+	} else { // subnormal, normalize it
+		exp = 113u;
+		while(!(mant & 0x400u)) {
+			mant <<= 1;
+			--exp;
+		}
+
+		bits = sign | (exp << 23) | ((mant & 0x3FFu) << 13);
+	}
+
+	float ret;
+	std::memcpy(&ret, &bits, 4);
+	return ret;
+}
+
+inline std::uint16_t floatToHalf(float value)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, 4);
+
+	std::uint32_t sign = (bits >> 16) & 0x8000u;
+	std::uint32_t abs = bits & 0x7FFFFFFFu;
+
+	auto round = [](std::uint32_t h, std::uint32_t rest, std::uint32_t halfway) {
+		return (rest > halfway || (rest == halfway && (h & 1u))) ? h + 1 : h;
+	};
+
+	if(abs > 0x7F800000u) { // nan
+		return sign | 0x7E00u;
+	} else if(abs >= 0x477FF000u) { // rounds to inf
+		return sign | 0x7C00u;
+	} else if(abs < 0x33000000u) { // rounds to zero
+		return sign;
+	} else if(abs < 0x38800000u) { // subnormal half
+		auto shift = 126u - (abs >> 23);
+		auto mant = (abs & 0x7FFFFFu) | 0x800000u;
+		auto h = round(mant >> shift, mant & ((1u << shift) - 1), 1u << (shift - 1));
+		return sign | h;
+	}
+
+	// normal, rebias the exponent (127 - 15)
+	auto h = round((abs - 0x38000000u) >> 13, abs & 0x1FFFu, 0x1000u);
+	return sign | h;
+}
+
+} // namespace detail
+
+/// Compile-time information about an ImageFormat and functions to load/store
+/// single pixels of it.
+/// Pixels are handled as words (in word order, see BasicImage), the channels are
+/// always ordered r, g, b, a when represented as vector.
+/// When represented as 8-bit vector, channels with a different depth are rounded
+/// to the nearest value and float channels are clamped to [0, 1].
+template<ImageFormat F>
+struct FormatTraits {
+	static constexpr ImageFormat format = F;
+
+	/// The number of bits/bytes (rounded up) one pixel needs.
+	static constexpr unsigned int bitSize = detail::describe(F).bits;
+	static constexpr unsigned int byteSize = (bitSize + 7) / 8;
+
+	/// Large enough to hold one pixel.
+	using Word = std::conditional_t<(bitSize > 32), std::uint64_t, std::uint32_t>;
+
+	/// The shift of the r, g, b, a channels inside a pixel word.
+	/// Channels not present in the format have a shift of -1.
+	static constexpr std::array<int, 4> shifts = detail::describe(F).shifts;
+
+	/// The number of bits of the r, g, b, a channels, 0 if not present.
+	static constexpr std::array<unsigned int, 4> depths = detail::describe(F).depths;
+
+	/// Whether the channels are stored as 16-bit floats.
+	static constexpr bool halfFloat = detail::describe(F).halfFloat;
+
+	/// Whether every channel is exactly one byte in memory.
+	/// Such formats can be converted using byte shuffles.
+	static constexpr bool byteChannels = detail::byteChannels(detail::describe(F));
+
+	/// Whether the format has color (rgb) channels/an alpha channel.
+	static constexpr bool color = shifts[0] >= 0 && shifts[1] >= 0 && shifts[2] >= 0;
+	static constexpr bool alpha = shifts[3] >= 0;
+
+	/// The format with reversed channel order, i.e. the format that describes the
+	/// same data in the other endianess. none if there is no such format.
+	static constexpr ImageFormat reversed = detail::describe(F).reversed;
+
+	/// The format describing this format in byte order (instead of word order).
+	/// \sa toggleByteWordOrder
+	static constexpr ImageFormat byteOrder = detail::nativeLittleEndian ? reversed : F;
+
+	/// Returns the memory offset in bytes (from the beginning of the pixel) of the byte
+	/// holding the channel with the given shift. Only valid for byteChannels formats.
+	static constexpr unsigned int bytePosition(int shift) {
+		return detail::nativeLittleEndian ? shift / 8 : byteSize - 1 - shift / 8;
+	}
+
+	/// Loads the pixel word from memory.
+	/// \param bitOffset The bit of the pixel in the given byte, counted from the most
+	/// significant bit. Must be 0 for formats with a bitSize that is a multiple of 8.
+	static Word load(const std::uint8_t* pixel, unsigned int bitOffset = 0) {
+		if constexpr(bitSize == 64 || bitSize == 32) {
+			Word word;
+			std::memcpy(&word, pixel, sizeof(word));
+			return word;
+		} else if constexpr(bitSize == 24) {
+			if constexpr(detail::nativeLittleEndian) {
+				return pixel[0] | (pixel[1] << 8) | (pixel[2] << 16);
+			} else {
+				return (pixel[0] << 16) | (pixel[1] << 8) | pixel[2];
+			}
+		} else if constexpr(bitSize == 16) {
+			std::uint16_t word;
+			std::memcpy(&word, pixel, 2);
+			return word;
+		} else if constexpr(bitSize == 8) {
+			return *pixel;
+		} else if constexpr(bitSize == 1) {
+			return (*pixel & (0x80u >> bitOffset)) ? 0xFFu : 0u;
+		} else {
+			return 0u;
+		}
+	}
+
+	/// Stores the pixel word into memory. For bit-sized formats, only the bits of
+	/// the pixel are changed.
+	static void store(std::uint8_t* pixel, Word word, unsigned int bitOffset = 0) {
+		if constexpr(bitSize == 64 || bitSize == 32) {
+			std::memcpy(pixel, &word, sizeof(word));
+		} else if constexpr(bitSize == 24) {
+			pixel[bytePosition(0)] = word & 0xFFu;
+			pixel[bytePosition(8)] = (word >> 8) & 0xFFu;
+			pixel[bytePosition(16)] = (word >> 16) & 0xFFu;
+		} else if constexpr(bitSize == 16) {
+			auto half = static_cast<std::uint16_t>(word);
+			std::memcpy(pixel, &half, 2);
+		} else if constexpr(bitSize == 8) {
+			*pixel = word & 0xFFu;
+		} else if constexpr(bitSize == 1) {
+			auto mask = 0x80u >> bitOffset;
+			*pixel = (word & 0x80u) ? (*pixel | mask) : (*pixel & ~mask);
+		}
+	}
+
+	/// Returns the raw value of the given channel in the given word.
+	static constexpr unsigned int channel(Word word, unsigned int i) {
+		return (word >> shifts[i]) & ((Word(1) << depths[i]) - 1);
+	}
+
+	/// Unpacks the given pixel word into a rgba color.
+	/// Channels not present in the format will be 0.
+	static nytl::Vec4u8 unpack(Word word) {
+		nytl::Vec4u8 ret {};
+		for(auto i = 0u; i < 4u; ++i) {
+			if(shifts[i] < 0) {
+				continue;
+			}
+
+			if constexpr(halfFloat) {
+				auto value = detail::halfToFloat(channel(word, i));
+				value = value > 0.f ? (value < 1.f ? value : 1.f) : 0.f; // nan -> 0
+				ret[i] = static_cast<std::uint8_t>(value * 255.f + 0.5f);
+			} else {
+				ret[i] = detail::toUnorm8(channel(word, i), depths[i]);
+			}
+		}
+
+		return ret;
+	}
+
+	/// Packs the given rgba color into a pixel word.
+	static Word pack(nytl::Vec4u8 color) {
+		Word ret = 0u;
+		for(auto i = 0u; i < 4u; ++i) {
+			if(shifts[i] < 0) {
+				continue;
+			}
+
+			Word value;
+			if constexpr(halfFloat) {
+				value = detail::floatToHalf(color[i] / 255.f);
+			} else {
+				value = detail::fromUnorm8(color[i], depths[i]);
+			}
+
+			ret |= value << shifts[i];
+		}
+
+		return ret;
+	}
+
+	static nytl::Vec4u8 read(const std::uint8_t* pixel, unsigned int bitOffset = 0) {
+		return unpack(load(pixel, bitOffset));
+	}
+
+	static void write(std::uint8_t* pixel, nytl::Vec4u8 color, unsigned int bitOffset = 0) {
+		store(pixel, pack(color), bitOffset);
+	}
+};
+
+/// Calls the given function with a FormatTraits object for the given runtime format
+/// and returns its result. Can be used to select the instantiation of a generic
+/// algorithm once and not for every pixel.
+/// Calls it with FormatTraits<ImageFormat::none> for invalid formats.
+template<typename Func>
+decltype(auto) visitFormat(ImageFormat format, Func&& func)
+{
+	using Format = ImageFormat;
+	switch(format) {
+		case Format::rgba8888: return func(FormatTraits<Format::rgba8888> {});
+		case Format::argb8888: return func(FormatTraits<Format::argb8888> {});
+		case Format::abgr8888: return func(FormatTraits<Format::abgr8888> {});
+		case Format::bgra8888: return func(FormatTraits<Format::bgra8888> {});
+		case Format::rgb888: return func(FormatTraits<Format::rgb888> {});
+		case Format::bgr888: return func(FormatTraits<Format::bgr888> {});
+		case Format::a8: return func(FormatTraits<Format::a8> {});
+		case Format::a1: return func(FormatTraits<Format::a1> {});
+		case Format::xrgb8888: return func(FormatTraits<Format::xrgb8888> {});
+		case Format::xbgr8888: return func(FormatTraits<Format::xbgr8888> {});
+		case Format::rgb565: return func(FormatTraits<Format::rgb565> {});
+		case Format::xrgb2101010: return func(FormatTraits<Format::xrgb2101010> {});
+		case Format::rgba16f: return func(FormatTraits<Format::rgba16f> {});
+		default: return func(FormatTraits<Format::none> {});
+	}
+}
+
+/// A typed view of a single image row.
+/// \tparam F The format of the row.
+/// \tparam Ptr The raw pointer type, uint8_t* for mutable rows.
+template<ImageFormat F, typename Ptr>
+class RowSpan {
+public:
+	using Traits = FormatTraits<F>;
+	static constexpr bool mutableData = std::is_same_v<Ptr, std::uint8_t*>;
+
+	Ptr data {}; // the byte holding the first pixel
+	unsigned int bitOffset {}; // bit offset of the first pixel, must be 0 for byte-sized formats
+	unsigned int width {}; // number of pixels
+
+public:
+	unsigned int size() const { return width; }
+
+	/// Returns the address of the given pixel and sets bit to its bit offset.
+	Ptr pixel(unsigned int x, unsigned int& bit) const {
+		if constexpr(Traits::bitSize % 8 == 0) {
+			bit = 0u;
+			return data + x * Traits::byteSize;
+		} else {
+			auto b = bitOffset + x * Traits::bitSize;
+			bit = b % 8;
+			return data + b / 8;
+		}
+	}
+
+	nytl::Vec4u8 get(unsigned int x) const {
+		unsigned int bit;
+		auto p = pixel(x, bit);
+		return Traits::read(p, bit);
+	}
+
+	void set(unsigned int x, nytl::Vec4u8 color) const {
+		static_assert(mutableData, "ny::RowSpan::set: row is not mutable");
+		unsigned int bit;
+		auto p = pixel(x, bit);
+		Traits::write(p, color, bit);
+	}
+
+	nytl::Vec4u8 operator[](unsigned int x) const { return get(x); }
+};
+
+/// Returns a typed view of the given image row.
+/// The format of the image must be F, this is not checked.
+template<ImageFormat F, typename P>
+auto rowSpan(const BasicImage<P>& img, unsigned int y)
+{
+	using Ptr = std::conditional_t<std::is_const_v<std::remove_reference_t<decltype(*data(img))>>,
+		const std::uint8_t*, std::uint8_t*>;
+
+	auto bit = img.bitOffset + std::uint64_t(y) * bitStride(img);
+	Ptr ptr = data(img) + bit / 8;
+	return RowSpan<F, Ptr> {ptr, static_cast<unsigned int>(bit % 8), img.size[0]};
+}
+
+/// Calls the given function for every pixel of the given image (row by row).
+/// The format of the image must be F, this is not checked.
+/// If the function takes the color as non-const reference (nytl::Vec4u8&), the
+/// color will be written back after the call, otherwise pixels are only read.
+/// The function may additionally take the position (nytl::Vec2ui) as first parameter.
+template<ImageFormat F, typename P, typename Func>
+void forEachPixel(const BasicImage<P>& img, Func&& func)
+{
+	using Color = nytl::Vec4u8;
+	constexpr auto pos = std::is_invocable_v<Func, nytl::Vec2ui, Color&>;
+	constexpr auto modifies = pos ?
+		!std::is_invocable_v<Func, nytl::Vec2ui, Color&&> :
+		!std::is_invocable_v<Func, Color&&>;
+
+	for(auto y = 0u; y < img.size[1]; ++y) {
+		auto row = rowSpan<F>(img, y);
+		for(auto x = 0u; x < row.size(); ++x) {
+			auto color = row.get(x);
+			if constexpr(pos) func(nytl::Vec2ui {x, y}, color);
+			else func(color);
+			if constexpr(modifies) row.set(x, color);
+		}
+	}
+}
+
+/// Like forEachPixel but selects the format instantiation from the images format.
+/// Does nothing for ImageFormat::none.
+template<typename P, typename Func>
+void forEachPixel(const BasicImage<P>& img, Func&& func)
+{
+	visitFormat(img.format, [&](auto traits) {
+		using Traits = decltype(traits);
+		if constexpr(Traits::format != ImageFormat::none) {
+			forEachPixel<Traits::format>(img, func);
+		}
+	});
+}
+
+} // namespace ny
@@ -5,9 +5,13 @@
 #pragma once
 
 #include <nytl/vec.hpp> // nytl::Vec
+#include <nytl/rect.hpp> // nytl::Rect
 #include <nytl/tmpUtil.hpp> // nytl::templatize
 #include <memory> // std::unique_ptr
 #include <cstring> // std::memcpy
+#include <cstdint> // std::uint64_t
+#include <cstddef> // std::size_t
+#include <type_traits> // std::enable_if_t
 #include <array> // std::array
 #include <cmath> // std::ceil
 
@@ -17,8 +21,10 @@ namespace ny {
 // implementation note at the top of image.cpp
 
 /// The differents formats in which image data can be represented.
-/// If one needs a 32-bit rgb color format (i.e. with 8 bits unused), just use a
-/// rgba/argb format and ensure that all alpha values are set to 255.
+/// Colors are always passed around with 8 bits per channel, channels with other
+/// depths are rounded to the nearest value when read or written.
+/// Unused (x) bits are treated like channels that are not present: they are read
+/// as 0 (e.g. the alpha value of xrgb8888 pixels) and written as 0.
 /// \sa imageDataFormatSize
 /// \sa ImageData
 enum class ImageFormat : unsigned int {
@@ -33,7 +39,13 @@ enum class ImageFormat : unsigned int {
 	bgr888, // reverse rgb
 
 	a8, // 8-bit alpha
-	a1 // 1-bit alpha
+	a1, // 1-bit alpha, most significant bit first. Read as 0 or 255 alpha
+
+	xrgb8888, // rgb with 8 unused bits
+	xbgr8888, // reverse rgb with 8 unused bits
+	rgb565, // 16-bit rgb, 5 bits red and blue, 6 bits green
+	xrgb2101010, // 10-bit rgb channels with 2 unused bits
+	rgba16f // 16-bit (half) float channels. Clamped to [0, 1] when read as 8-bit
 };
 
 /// Returns whether the current machine is little endian.
@@ -67,8 +79,67 @@ unsigned int byteSize(ImageFormat format);
 /// Example: bitSize(ImageFormat::bgr888) returns
 ///  - on little endian: ImageFormat::rgb888 (reversed).
 ///  - on big endian: ImageFormat::bgr888 (not changed).
+/// On little endian, returns ImageFormat::none for formats whose reversed
+/// channel order can't be expressed as ImageFormat (e.g. xrgb8888 or rgb565).
 ImageFormat toggleByteWordOrder(const ImageFormat& format);
 
+/// Alignment of all image data allocated by ImageAllocator in bytes.
+/// Passing 8 * imageDataAlign as alignNewStride to the functions that
+/// create new images makes every row start at a cache line.
+constexpr auto imageDataAlign = 64u;
+
+/// Interface for the allocation of owned image data, see UniqueImage.
+/// All functions returning a UniqueImage allocate the data using the
+/// allocator returned by imageAllocator().
+/// Implementations must be thread-safe.
+class ImageAllocator {
+public:
+	virtual ~ImageAllocator() = default;
+
+	/// Returns at least size bytes aligned to imageDataAlign bytes.
+	/// \throw std::bad_alloc if the memory can't be allocated.
+	virtual std::uint8_t* allocate(std::size_t size) = 0;
+
+	/// Frees memory previously returned by allocate, size is the requested size.
+	virtual void free(std::uint8_t* data, std::size_t size) = 0;
+};
+
+/// Returns the allocator used for new UniqueImage data.
+/// By default this is an allocator that keeps freed blocks in power-of-two
+/// size classes (up to 4 MiB) for reuse, so frequently converted images (like
+/// cursors or icons) don't need a new heap allocation every time.
+ImageAllocator& imageAllocator();
+
+/// Sets the allocator used for new UniqueImage data. Data allocated before
+/// is still freed with the allocator it was allocated with, i.e. the given
+/// allocator must stay valid until all images allocated with it are destroyed.
+/// Passing nullptr restores the default allocator.
+void imageAllocator(ImageAllocator*);
+
+/// Deleter for image data that returns it to the allocator it came from.
+/// Data without allocator (e.g. from std::make_unique<std::uint8_t[]>) is deleted
+/// with delete[], so such data can still be assigned to UniqueImage objects.
+struct ImageDataDeleter {
+	ImageAllocator* allocator {};
+	std::size_t size {};
+
+	ImageDataDeleter() = default;
+	ImageDataDeleter(ImageAllocator& xallocator, std::size_t xsize)
+		: allocator(&xallocator), size(xsize) {}
+	ImageDataDeleter(std::default_delete<std::uint8_t[]>) {}
+
+	void operator()(std::uint8_t* data) const {
+		if(allocator) allocator->free(data, size);
+		else delete[] data;
+	}
+};
+
+/// Owned image data, see UniqueImage.
+using UniqueImageData = std::unique_ptr<std::uint8_t[], ImageDataDeleter>;
+
+/// Allocates image data of the given size with imageAllocator().
+UniqueImageData allocateImageData(std::size_t size);
+
 namespace detail {
 
 template<typename T, typename F>
@@ -76,8 +147,8 @@ constexpr void copy(T& to, F from, unsigned int) {
 	to = from;
 }
 
-template<typename T, typename PF>
-void copy(T& to, const std::unique_ptr<PF[]>& from, unsigned int) {
+template<typename T, typename PF, typename D>
+void copy(T& to, const std::unique_ptr<PF[], D>& from, unsigned int) {
 	to = from.get();
 }
 
@@ -104,6 +175,23 @@ void copy(std::unique_ptr<PT[]>& to, const std::unique_ptr<PF[]>& from,
 	std::memcpy(to.get(), from.get(), size);
 }
 
+template<typename F>
+std::enable_if_t<std::is_convertible_v<F, const uint8_t*>>
+copy(UniqueImageData& to, F from, unsigned int size) {
+	if(!from) {
+		to = {};
+		return;
+	}
+
+	to = allocateImageData(size);
+	std::memcpy(to.get(), from, size);
+}
+
+template<typename PF, typename D>
+void copy(UniqueImageData& to, const std::unique_ptr<PF[], D>& from, unsigned int size) {
+	copy(to, static_cast<const uint8_t*>(from.get()), size);
+}
+
 } // namespace detail
 
 template<typename P> class BasicImage;
@@ -135,6 +223,9 @@ template<typename P> constexpr unsigned int bitStride(const BasicImage<P>& img);
 /// a pixel 0xAABBCCDD has format rgba8888, this pixel will be interpreted as
 /// rgba(0xAA, 0xBB, 0xCC, 0xDD) independent from endianess (note that on little endian
 /// this is not how it is layed out in memory).
+/// Images can be views into other images (see subImage). For formats whose bitSize is
+/// not a multiple of 8, the first pixel of such a view might not start at a byte boundary,
+/// therefore the bit offset of the first pixel is stored as well.
 /// There are several helper functions that make dealing with BasicImage objects easier.
 /// \tparam P The pointer type to used. Should be a type that can be used as std::uint8_t*.
 /// Might be a cv-qualified or smart pointer.
@@ -145,18 +236,20 @@ public:
 	nytl::Vec2ui size {}; // image size in pixels
 	ImageFormat format {}; // data format in word order (endian-native)
 	unsigned int stride {}; // stride in bits. At least size[0] * bitSize(format)
+	unsigned int bitOffset {}; // bit of the first pixel in data, from the most significant bit
 
 public:
 	constexpr BasicImage() = default;
 	~BasicImage() = default;
 
-	constexpr BasicImage(P xdata, nytl::Vec2ui xsize, const ImageFormat& fmt, unsigned int strd = 0)
-		: data(std::move(xdata)), size(xsize), format(fmt), stride(strd)
-		{ if(!stride) stride = size[0] * bitSize(format); }
+	constexpr BasicImage(P xdata, nytl::Vec2ui xsize, const ImageFormat& fmt,
+		unsigned int strd = 0, unsigned int bitOff = 0)
+			: data(std::move(xdata)), size(xsize), format(fmt), stride(strd), bitOffset(bitOff)
+			{ if(!stride) stride = size[0] * bitSize(format); }
 
 	template<typename O>
 	constexpr BasicImage(const BasicImage<O>& lhs)
-		: size(lhs.size), format(lhs.format), stride(bitStride(lhs))
+		: size(lhs.size), format(lhs.format), stride(bitStride(lhs)), bitOffset(lhs.bitOffset)
 		{ detail::copy(data, lhs.data, dataSize(lhs)); }
 
 	template<typename O>
@@ -164,18 +257,20 @@ public:
 		size = lhs.size;
 		format = lhs.format;
 		stride = bitStride(lhs);
+		bitOffset = lhs.bitOffset;
 		detail::copy(data, lhs.data, dataSize(lhs));
 		return *this;
 	}
 
 	constexpr BasicImage(const BasicImage& lhs)
-		: size(lhs.size), format(lhs.format), stride(bitStride(lhs))
+		: size(lhs.size), format(lhs.format), stride(bitStride(lhs)), bitOffset(lhs.bitOffset)
 		{ detail::copy(data, lhs.data, dataSize(lhs)); }
 
 	constexpr BasicImage& operator=(const BasicImage& lhs) {
 		size = lhs.size;
 		format = lhs.format;
 		stride = bitStride(lhs);
+		bitOffset = lhs.bitOffset;
 		detail::copy(data, lhs.data, dataSize(lhs));
 		return *this;
 	}
@@ -186,7 +281,7 @@ public:
 
 using Image = BasicImage<const uint8_t*>; /// Default, immutable, non-owned BasicImgae typedef.
 using MutableImage = BasicImage<uint8_t*>; /// Mutable, non-owned BasicImage typedef
-using UniqueImage = BasicImage<std::unique_ptr<uint8_t[]>>; /// Mutable, owned BasicImage typedef
+using UniqueImage = BasicImage<UniqueImageData>; /// Mutable, owned BasicImage typedef
 using SharedImage = BasicImage<std::shared_ptr<uint8_t[]>>; /// Mutable, shared BasicImage typedef
 
 /// Returns the stride of the given BasicImage in bits.
@@ -201,12 +296,35 @@ template<typename P>
 constexpr unsigned int byteStride(const BasicImage<P>& img)
 	{ return img.stride ? std::ceil(img.stride / 8) : img.size[0] * byteSize(img.format); }
 
-/// Returns the total amount of bytes the image data holds (rounded up).
+/// Returns the total amount of bytes the image data holds (rounded up), i.e. the
+/// number of bytes from data up to (including) the byte of the last pixel.
+/// For views (see subImage) this does not include the data of the parent image
+/// after the last row.
+template<typename P>
+constexpr unsigned int dataSize(const BasicImage<P>& img) {
+	if(!img.size[0] || !img.size[1]) return 0u;
+	auto bits = img.bitOffset + std::uint64_t(bitStride(img)) * (img.size[1] - 1) +
+		std::uint64_t(img.size[0]) * bitSize(img.format);
+	return (bits + 7) / 8;
+}
+
+/// Returns a view of the given rectangle of the given image, without copying any data.
+/// The returned image references the data of the given image and has the same
+/// format and stride. Its bitOffset is set if the rectangle does not start at a byte
+/// boundary (only possible for formats whose bitSize is not a multiple of 8).
+/// For owned images (e.g. UniqueImage), a non-owned MutableImage view is returned.
+/// The rectangle must be inside the given image, this is not checked.
 template<typename P>
-constexpr unsigned int dataSize(const BasicImage<P>& img)
-	{ return std::ceil(bitStride(img) * img.size[1] / 8.0); }
+constexpr auto subImage(const BasicImage<P>& img, nytl::Vec2ui offset, nytl::Vec2ui size) {
+	using Ptr = decltype(data(img));
+	auto stride = bitStride(img);
+	auto bit = img.bitOffset + std::uint64_t(offset[1]) * stride +
+		std::uint64_t(offset[0]) * bitSize(img.format);
+	return BasicImage<Ptr>(data(img) + bit / 8, size, img.format, stride, bit % 8);
+}
 
 /// Returns the bit of the given Image at which the pixel for the given position begins.
+/// Includes the bit offset of the image.
 unsigned int pixelBit(const Image&, nytl::Vec2ui position);
 
 /// Returns the color of the image at at the given position.
@@ -243,25 +361,115 @@ nytl::Vec4f norm(nytl::Vec4u64 color, ImageFormat format);
 
 /// Returns whether an ImageData object satisfied the given requirements.
 /// Returns false if the stride of the given ImageData satisfies the given align but
-/// is not as small as possible.
+/// is not as small as possible or if it has a bit offset.
 /// \param strideAlign The required alignment of the stride in bits
 bool satisfiesRequirements(const Image&, ImageFormat, unsigned int strideAlign = 0);
 
 /// Can be used to convert image data to another format or to change its stride alignment.
+/// Channels that are not present in the source format will be zero in the converted data.
+/// The conversion is done row-wise with (where available) vectorized converters.
 /// \param alignNewStride Can be used to pass a alignment requirement for the stride of the
 /// new (converted) data. Defaulted to 0, in which case the packed size will be used as stride.
+/// The data of the returned image is aligned to imageDataAlign bytes, so passing
+/// 8 * imageDataAlign makes every row start at a cache line.
 /// \sa BasicImageData
 /// \sa ImageDataFormat
 UniqueImage convertFormat(const Image&, ImageFormat to, unsigned int alignNewStride = 0);
 void convertFormat(const Image&, ImageFormat to, uint8_t& into, unsigned int alignNewStride = 0);
 
+/// Converts the given image into the given destination image, respecting the format,
+/// stride and bit offset of the destination. Can e.g. be used with subImage views to
+/// update only a part of an image. Data outside the destination view is not changed.
+/// \throw std::logic_error if the sizes of the images are different.
+void convertFormat(const Image& src, const MutableImage& dst);
+
+/// Multithreaded versions of convertFormat for large images.
+/// The image is split into bands of rows which are converted by an internal
+/// worker pool (created when an image is split up the first time) and the calling thread.
+/// Small images are always converted on the calling thread only.
+/// \param threads The maximum number of threads to use, including the calling
+/// thread. 0 uses all available hardware threads.
+UniqueImage convertFormat(const Image&, ImageFormat to, unsigned int alignNewStride,
+	unsigned int threads);
+void convertFormat(const Image&, ImageFormat to, uint8_t& into, unsigned int alignNewStride,
+	unsigned int threads);
+
+/// Converts the given image to the given format without any additional memory.
+/// Only possible between formats with the same bitSize, e.g. between rgba8888 and
+/// bgra8888 or between rgb888 and bgr888. Like convertFormat, channels not present
+/// in the source format will be zero.
+/// Returns a view of the same data with the new format since the format of the
+/// given image itself can't be changed.
+/// \throw std::logic_error if the formats have different bit sizes.
+MutableImage convertFormatInPlace(const MutableImage&, ImageFormat to);
+
+/// Like convertFormat but uses ordered (4x4 bayer) dithering instead of rounding
+/// to the nearest value for color channels with less than 8 bits, e.g. when
+/// converting to rgb565. Avoids visible banding in gradients.
+/// For other destination formats equal to convertFormat.
+/// \throw std::logic_error if the sizes of the images are different.
+UniqueImage convertFormatDithered(const Image&, ImageFormat to, unsigned int alignNewStride = 0);
+void convertFormatDithered(const Image& src, const MutableImage& dst);
+
 /// Returns whether the given format has an alpha component.
 /// Despite the name, this will return false for the a1 and a8 image formats.
 bool alphaComponent(ImageFormat);
 
 /// Premutliplies the alpha factors for the given image.
+/// Every color channel c is set to c * alpha / 255, rounded to the nearest integer.
 /// Has no effect if the given image has no alpha channel or only an alpha channel.
 /// \param resetAlpha Sets all alpha values to zero why premultiplying if true.
 void premultiply(const MutableImage& img, bool resetAlpha = false);
 
+/// Multithreaded version of premultiply for large images.
+/// \param threads The maximum number of threads to use, see the multithreaded
+/// convertFormat overloads.
+void premultiply(const MutableImage& img, bool resetAlpha, unsigned int threads);
+
+/// Reverts premultiply for the given image, i.e. sets every color channel c to
+/// c * 255 / alpha (rounded, clamped to 255). The color channels of fully
+/// transparent pixels will be zero. Values that were rounded by premultiply
+/// can obviously not be restored.
+/// Has no effect if the given image has no alpha channel or only an alpha channel.
+void unpremultiply(const MutableImage& img);
+
+/// Like convertFormat but additionally premultiplies the converted data.
+/// Has the same result as calling premultiply on the converted image, but
+/// processes the data in one pass. Useful e.g. for the argb8888 buffers
+/// used by wayland and other compositors that expect premultiplied alpha.
+/// \sa convertFormat
+/// \sa premultiply
+UniqueImage convertPremultiply(const Image&, ImageFormat to, unsigned int alignNewStride = 0);
+void convertPremultiply(const Image&, ImageFormat to, uint8_t& into,
+	unsigned int alignNewStride = 0);
+
+/// Operators for composite.
+enum class CompositeOp {
+	source, // the source replaces the destination, same as blit
+	over // Porter-Duff over, for premultiplied alpha
+};
+
+/// Sets all pixels in the given rectangle of the image to the given color.
+/// The rectangle is clipped to the image. The color is written as it is, i.e. it
+/// has to be premultiplied already when filling a premultiplied image.
+/// Only the first row is written pixel by pixel, all other rows are copied from it.
+void fill(const MutableImage&, const nytl::Rect2ui& rect, nytl::Vec4u8 color);
+void fill(const MutableImage&, nytl::Vec4u8 color);
+
+/// Copies the source image into the destination image at the given position,
+/// converting the format if needed (see convertFormat). The parts of the source
+/// that would be outside the destination are clipped.
+void blit(const Image& src, const MutableImage& dst, nytl::Vec2i position);
+
+/// Composites the source image onto the destination image at the given position
+/// using the given operator. Both images are expected to have premultiplied alpha
+/// (see premultiply). Source formats without alpha channel are opaque,
+/// destination formats without alpha channel are treated as opaque as well.
+/// Like blit, parts outside the destination are clipped.
+/// The blending is vectorized for 32-bit formats with 8-bit channels (e.g. the
+/// argb8888 and xrgb8888 buffers of BufferSurface), other formats are converted
+/// to such a format in small blocks.
+void composite(const Image& src, const MutableImage& dst, nytl::Vec2i position,
+	CompositeOp op = CompositeOp::over);
+
 } // namespace nytl
@@ -29,7 +29,10 @@ public:
 	// - AppContext implementation -
 	bool pollEvents() override;
 	bool waitEvents() override;
+	bool waitEvents(std::chrono::steady_clock::time_point deadline) override;
 	void wakeupWait() override;
+	nytl::Connection addTimer(std::chrono::steady_clock::duration duration,
+		bool repeat, std::function<void()> callback) override;
 
 	MouseContext* mouseContext() override;
 	KeyboardContext* keyboardContext() override;
@@ -45,6 +48,7 @@ public:
 	// - wayland specific -
 	/// Can be called to register custom listeners for fds that the dispatch loop will
 	/// then poll for. Should return false if it wants to be disconnected.
+	/// The events are poll events, EPOLLET can be added for edge-triggered notification.
 	using FdCallbackFunc = std::function<bool(int fd, unsigned int events)>;
 	nytl::Connection fdCallback(int fd, unsigned int events, const FdCallbackFunc& func);
 
@@ -90,13 +94,15 @@ protected:
 	bool checkError() const;
 
 	/// Modified version of wl_dispatch_display that performs the same operations but
-	/// does also poll for the registered fds.
+	/// does also poll for the registered fds. Returns after at most timeout
+	/// milliseconds (-1 for infinite) when waiting for events.
 	/// Returns false on error.
-	bool dispatchDisplay();
+	bool dispatchDisplay(int timeout = -1);
 
 	/// Polls for all registered fd callbacks as well as for the wayland display fd
 	/// with the given events if they are not 0. Uses the given timeout for poll calls.
-	/// Returns the value poll returned.
+	/// The fd callbacks are in a persistent epoll set which is polled together
+	/// with the display fd. Returns the value poll returned.
 	/// Will not stop on a signal.
 	int pollFds(short wlDisplayEvents, int timeout);
 
@@ -6,32 +6,84 @@
 
 #include <ny/wayland/include.hpp>
 #include <ny/wayland/windowContext.hpp>
+#include <ny/wayland/util.hpp>
 #include <ny/bufferSurface.hpp>
 
 #include <nytl/vec.hpp>
 #include <nytl/nonCopyable.hpp>
 
-#include <vector>
+#include <cstdint> // std::uint64_t
+#include <chrono> // std::chrono::nanoseconds
+#include <deque> // std::deque
+#include <memory> // std::unique_ptr
+#include <optional> // std::optional
 
 namespace ny {
 
 /// Wayland BufferSurface implementation.
+/// All buffers are sub-allocated from one shm pool, so resizing them does
+/// only create new wl_buffers and (rarely) grow the pool.
+/// Uses at most maxBuffers buffers. When all of them are held by the compositor,
+/// buffer() waits for one to be released. The release events are dispatched
+/// on a separate event queue, so no other events are dispatched meanwhile.
 class WaylandBufferSurface : public nytl::NonCopyable, public BufferSurface {
 public:
-	WaylandBufferSurface(WaylandWindowContext&);
+	static constexpr auto defaultMaxBuffers = 3u;
+
+	/// Counters that allow to measure the cost of buffer management.
+	struct Stats {
+		std::uint64_t frames {}; // number of applied buffers
+		std::uint64_t allocations {}; // number of created/resized buffers
+		std::chrono::nanoseconds allocationTime {}; // time spent creating/resizing buffers
+		std::uint64_t pageFaults {}; // page faults of this thread while buffers were active
+	};
+
+	struct Buffer {
+		wayland::PoolBuffer buffer;
+
+		// for buffer age tracking: the number of the present (starting at 1) in which
+		// the buffer was last presented. 0 if its contents are undefined
+		std::uint64_t presented {};
+	};
+
+public:
+	WaylandBufferSurface(WaylandWindowContext&, unsigned int maxBuffers = 0);
 	~WaylandBufferSurface();
 
 	BufferGuard buffer() override;
 	void apply(const BufferGuard&) noexcept override;
 
+	/// Like buffer but does not block if all buffers are in use by the
+	/// compositor. Returns an empty optional in this case.
+	std::optional<BufferGuard> tryBuffer();
+
 	WaylandWindowContext& windowContext() const { return *windowContext_; }
-	const std::vector<wayland::ShmBuffer>& shmBuffers() const { return buffers_; }
-	wayland::ShmBuffer* active() const { return active_; }
+	const std::deque<Buffer>& shmBuffers() const { return buffers_; }
+	const wayland::ShmPool& shmPool() const { return pool_; }
+	wayland::PoolBuffer* active() const { return active_ ? &active_->buffer : nullptr; }
+	unsigned int maxBuffers() const { return maxBuffers_; }
+	const Stats& stats() const { return stats_; }
+
+protected:
+	/// Returns an unused buffer or nullptr if there is none and block is false.
+	Buffer* acquire(bool block);
+	unsigned int prepare(Buffer&); // resizes and activates the buffer, returns its age
+	MutableImage image(Buffer&) const;
+
+	struct QueueDeleter {
+		void operator()(wl_event_queue*) const;
+	};
 
 protected:
 	WaylandWindowContext* windowContext_ {};
-	std::vector<wayland::ShmBuffer> buffers_;
-	wayland::ShmBuffer* active_ {};
+	std::unique_ptr<wl_event_queue, QueueDeleter> queue_; // must outlive the buffers
+	wayland::ShmPool pool_;
+	std::deque<Buffer> buffers_; // deque since the buffers must not be moved
+	Buffer* active_ {};
+	unsigned int maxBuffers_ {};
+	std::uint64_t presentCount_ {};
+	Stats stats_ {};
+	std::uint64_t faults_ {}; // page faults of the thread when the active buffer was acquired
 };
 
 /// WaylandWindowContext for a BufferSurface.
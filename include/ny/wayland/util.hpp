@@ -11,6 +11,7 @@
 #include <nytl/vec.hpp>
 #include <nytl/callback.hpp>
 #include <nytl/functionTraits.hpp>
+#include <nytl/nonCopyable.hpp>
 
 #include <type_traits>
 #include <vector>
@@ -20,10 +21,10 @@ namespace ny {
 namespace wayland {
 
 // TODO: shmbuffer in preferred format, don't just always use argb
-// TODO: use one shared shm_pool for all ShmBuffers?
-// At least use pool of pools but not one for every buffer. This is really bad
 
-/// Wraps and manages a wayland shm buffer.
+/// Wraps and manages a wayland shm buffer with its own shm pool.
+/// Used for single buffers (e.g. cursor images), see ShmPool and PoolBuffer
+/// for buffers that are frequently recreated.
 class ShmBuffer {
 public:
 	ShmBuffer() = default;
@@ -77,6 +78,100 @@ protected:
 	void released(wl_buffer*) { used_ = false; } // registered as listener function
 };
 
+/// A wl_shm_pool backed by a single anonymous file.
+/// The pool only grows (using wl_shm_pool_resize and mremap), buffers
+/// are sub-allocated from it using a simple first-fit allocator.
+/// Note that growing the pool may change the data pointer, so the
+/// data of sub-allocated buffers must always be accessed using their offset.
+class ShmPool : public nytl::NonMovable {
+public:
+	/// If queue is not null, the pool and all buffers created from it will use
+	/// it instead of the default event queue.
+	ShmPool(WaylandAppContext& ac, wl_event_queue* queue = nullptr)
+		: appContext_(&ac), queue_(queue) {}
+	~ShmPool();
+
+	/// Allocates a range of the given size, grows the pool if needed.
+	/// Returns the offset of the range in the pool.
+	/// Throws std::runtime_error if the pool could not be created/grown.
+	unsigned int allocate(unsigned int size);
+
+	/// Frees a range previously returned by allocate.
+	void free(unsigned int offset, unsigned int size);
+
+	WaylandAppContext& appContext() const { return *appContext_; }
+	wl_shm_pool* wlShmPool() const { return pool_; }
+	uint8_t* data() const { return data_; }
+	unsigned int size() const { return size_; }
+
+	/// The alignment of all allocated ranges.
+	static constexpr auto alignment = 64u;
+
+	/// Pools of at least this size are rounded up to a multiple of hugePageSize
+	/// and advised to use transparent huge pages (if enabled for shmem), which
+	/// reduces tlb misses and page faults when filling large buffers.
+	static constexpr auto hugePageThreshold = 4u * 1024u * 1024u;
+	static constexpr auto hugePageSize = 2u * 1024u * 1024u;
+
+protected:
+	void grow(unsigned int size);
+
+	struct Range {
+		unsigned int offset;
+		unsigned int size;
+	};
+
+	WaylandAppContext* appContext_ {};
+	wl_event_queue* queue_ {};
+	wl_shm_pool* pool_ {};
+	uint8_t* data_ {};
+	unsigned int size_ {};
+	int fd_ {-1};
+	std::vector<Range> free_; // sorted by offset, never adjacent
+};
+
+/// Wayland shm buffer that is sub-allocated from a ShmPool.
+/// Resizing it only creates a new wl_buffer (and a new range of the pool
+/// if the current one is too small).
+class PoolBuffer {
+public:
+	PoolBuffer() = default;
+	PoolBuffer(ShmPool& pool, nytl::Vec2ui size, unsigned int stride = 0);
+	~PoolBuffer();
+
+	PoolBuffer(PoolBuffer&& other) noexcept;
+	PoolBuffer& operator=(PoolBuffer&& other) noexcept;
+
+	nytl::Vec2ui size() const { return size_; }
+	unsigned int format() const { return format_; }
+	unsigned int stride() const { return stride_; }
+	uint8_t& data() { return *(pool_->data() + offset_); }
+	wl_buffer& wlBuffer() const { return *buffer_; }
+
+	/// Marks the buffer as used by the compositor until it is released.
+	/// \sa ShmBuffer::use
+	void use() { used_ = true; }
+	bool used() const { return used_; }
+
+	/// Changes the size of the buffer. This will always create a new
+	/// wl_buffer, the buffer must not be in use.
+	void size(nytl::Vec2ui size, unsigned int stride = 0);
+
+protected:
+	void create();
+	void destroy();
+	void released(wl_buffer*) { used_ = false; }
+
+	ShmPool* pool_ {};
+	nytl::Vec2ui size_ {};
+	unsigned int stride_ {};
+	unsigned int offset_ {};
+	unsigned int rangeSize_ {}; // size of the allocated range in the pool
+	wl_buffer* buffer_ {};
+	unsigned int format_ {};
+	bool used_ {};
+};
+
 /// Holds information about a wayland output.
 class Output {
 public:
@@ -210,48 +305,6 @@ struct MemberCallback<F, f, void(Args...), true> {
 template<auto f, typename S = typename nytl::FunctionTraits<decltype(f)>::Signature, bool L = false>
 constexpr auto memberCallback = &detail::MemberCallback<std::decay_t<decltype(f)>, f, S, L>::call;
 
-// TODO: does not belong here... rather some common util file
-/// Utility template that allows a generic list of connectable objects.
-/// Used by WaylandAppContext for its fd listeners.
-template<typename T>
-class ConnectionList : public nytl::Connectable {
-public:
-	struct Value : public T {
-		using T::T;
-		nytl::ConnectionID clID_;
-	};
-
-	std::vector<Value> items;
-	nytl::ConnectionID highestID;
-
-public:
-	bool disconnect(const nytl::ConnectionID& id) override
-	{
-		for(auto it = items.begin(); it != items.end(); ++it) {
-			if(it->clID_.get() == id.get()) {
-				items.erase(it);
-				return true;
-			}
-		}
-
-		return false;
-	}
-
-	nytl::Connection add(const T& value)
-	{
-		items.emplace_back();
-		static_cast<T&>(items.back()) = value;
-		items.back().clID_ = {nextID()};
-		return {*this, items.back().clID_};
-	}
-
-	nytl::ConnectionID nextID()
-	{
-		++reinterpret_cast<std::uintptr_t&>(highestID);
-		return highestID;
-	}
-};
-
 ///Used for e.g. move/resize requests where the serial of the trigger can be given
 ///All wayland event callbacks that retrieve a serial value should create a WaylandEventData
 ///object and pass it to the event handler.
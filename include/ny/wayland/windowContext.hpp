@@ -10,6 +10,8 @@
 #include <ny/windowContext.hpp> // ny::WindowContexts
 #include <ny/windowSettings.hpp> // ny::WindowSettings
 #include <nytl/vec.hpp> // nytl::Vec
+#include <nytl/rect.hpp> // nytl::Rect
+#include <nytl/span.hpp> // nytl::Span
 
 namespace ny {
 
@@ -90,7 +92,9 @@ public:
 	/// If called with a nullptr, no framecallback will be attached and the surface will
 	/// be unmapped. Note that if the WindowContext is currently hidden or not mapped,
 	/// no buffer will be attached.
-	void attachCommit(wl_buffer* buffer);
+	/// Damages only the given rectangles (in buffer coordinates) if there are any,
+	/// otherwise the whole surface.
+	void attachCommit(wl_buffer* buffer, nytl::Span<const nytl::Rect2ui> damage = {});
 
 	WaylandAppContext& appContext() const { return *appContext_; }
 	wl_display& wlDisplay() const;
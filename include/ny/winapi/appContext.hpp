@@ -35,6 +35,7 @@ public:
 
 	bool pollEvents() override;
 	bool waitEvents() override;
+	using AppContext::waitEvents;
 	void wakeupWait() override;
 
 	bool clipboard(std::unique_ptr<DataSource>&& source) override;
@@ -108,6 +108,11 @@ struct BufferSurfaceSettings {
 	///object (see surface.hpp).
 	///Can be nullptr.
 	BufferSurface** storeSurface {};
+
+	/// The maximum number of buffers the surface uses for presenting
+	/// asynchronously. When all of them are still in use by the display server,
+	/// retrieving a new buffer blocks. 0 means the backend default (usually 3).
+	unsigned int maxBuffers {};
 };
 
 /// Used as magical signal value for no specific postion.
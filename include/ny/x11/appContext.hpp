@@ -9,18 +9,28 @@
 #include <ny/deferred.hpp>
 #include <ny/windowSettings.hpp>
 
+#include <nytl/connection.hpp> // nytl::Connection
+
 #include <map>
 #include <memory>
+#include <functional> // std::function
 
 namespace ny {
 
+/// Additional settings for a X11AppContext.
+struct X11AppContextSettings {
+	/// Whether to call XInitThreads. Only needed if Xlib is used from multiple
+	/// threads (e.g. glx on another thread). wakeupWait is threadsafe without it.
+	bool initThreads {};
+};
+
 /// X11 AppContext implementation.
 class X11AppContext : public AppContext {
 public:
 	DeferredOperator<void(), WindowContext*> deferred;
 
 public:
-	X11AppContext();
+	X11AppContext(const X11AppContextSettings& = {});
 	~X11AppContext();
 
 	// - AppContext -
@@ -30,7 +40,10 @@ public:
 
 	bool pollEvents() override;
 	bool waitEvents() override;
+	bool waitEvents(std::chrono::steady_clock::time_point deadline) override;
 	void wakeupWait() override;
+	nytl::Connection addTimer(std::chrono::steady_clock::duration duration,
+		bool repeat, std::function<void()> callback) override;
 
 	bool clipboard(std::unique_ptr<DataSource>&& dataSource) override;
 	DataOffer* clipboard() override;
@@ -44,6 +57,21 @@ public:
 	X11WindowContext* windowContext(xcb_window_t);
 	bool checkError();
 
+	/// Blocks until an event is read for which the given function returns true.
+	/// That event is processed, all other events read in the meantime are
+	/// queued and dispatched by the next call to pollEvents or waitEvents.
+	/// Can be used to wait for specific events (e.g. from within a draw handler)
+	/// without dispatching others. Returns false on connection errors.
+	bool waitFor(const std::function<bool(const x11::GenericEvent&)>& pred);
+
+	/// Registers a callback for the given fd that is triggered from pollEvents or
+	/// waitEvents when one of the given poll events (e.g. POLLIN) occurs, i.e. waitEvents
+	/// waits for them in addition to the x connection. EPOLLET can be added to
+	/// events for edge-triggered notification. Should return false if it wants
+	/// to be disconnected. Matches WaylandAppContext::fdCallback.
+	using FdCallbackFunc = std::function<bool(int fd, unsigned int events)>;
+	nytl::Connection fdCallback(int fd, unsigned int events, const FdCallbackFunc& func);
+
 	Display& xDisplay() const { return *xDisplay_; }
 	xcb_connection_t& xConnection() const { return *xConnection_; }
 	x11::EwmhConnection& ewmhConnection() const;
@@ -64,6 +92,7 @@ public:
 	auto ewmhWindowCaps() const { return ewmhWindowCaps_; }
 
 	bool xinput() const { return xiOpcode_; }
+	int presentOpcode() const { return presentOpcode_; } /// 0 if present is not supported
 
 protected:
 	Display* xDisplay_  = nullptr;
@@ -84,9 +113,14 @@ protected:
 
 	WindowCapabilities ewmhWindowCaps_ {};
 	int xiOpcode_ {};
+	int shmCompletionEvent_ {}; // response type of shm completion events, 0 if no shm
+	int presentOpcode_ {};
 
 	struct Impl;
 	std::unique_ptr<Impl> impl_;
+
+	x11::GenericEvent* pollEvent();
+	bool dispatchWait(int timeout); // timeout in milliseconds, -1 for infinite
 };
 
 } // namespace ny
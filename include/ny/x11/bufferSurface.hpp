@@ -10,17 +10,32 @@
 
 #include <nytl/vec.hpp>
 #include <nytl/nonCopyable.hpp>
+#include <nytl/callback.hpp> // nytl::Callback
+#include <nytl/span.hpp> // nytl::Span
+#include <nytl/rect.hpp> // nytl::Rect2ui
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 struct xcb_image_t;
 
 namespace ny {
 
 /// X11 BufferSurface implementation.
+/// By default, the damaged regions of the contents are put into the window directly.
+/// When present is enabled (see X11WindowSettings::bufferPresent) and supported
+/// by the server, the shm segments are instead wrapped into pixmaps that are
+/// presented with xcb_present_pixmap, i.e. tear-free and synchronized with vblank.
+/// The whole pixmap is presented then, the damage of the BufferGuard is ignored.
 class X11BufferSurface : public nytl::NonMovable, public BufferSurface {
 public:
-	X11BufferSurface(X11WindowContext&);
+	/// Called when a frame presented with the present extension reached the screen.
+	/// Passes the time in microseconds (ust) and the vblank counter (msc) of it.
+	nytl::Callback<void(const X11BufferSurface&, std::uint64_t ust, std::uint64_t msc)> onPresent;
+
+public:
+	X11BufferSurface(X11WindowContext&, unsigned int maxSegments = 0, bool present = false);
 	~X11BufferSurface();
 
 	BufferGuard buffer() override;
@@ -29,30 +44,84 @@ public:
 	xcb_connection_t& xConnection() const { return windowContext().xConnection(); }
 	ImageFormat format() const { return format_; }
 	bool shm() const { return shm_; }
+	bool present() const { return present_; }
+	unsigned int maxSegments() const { return maxSegments_; }
 	bool active() const { return active_; }
 
+	/// Marks the segment with the given shm_put_image request as read by
+	/// the server and therefore reusable. Called by X11BufferWindowContext.
+	void shmCompletion(uint32_t shmseg, uint32_t sequence);
+
+	/// Handles present idle and complete notify events.
+	/// Called by X11BufferWindowContext.
+	void presentEvent(const x11::GenericEvent&);
+
 protected:
+	/// A shm segment the window contents are drawn into.
+	/// It is busy from the shm_put_image requests presenting it until the server
+	/// has finished reading it (signaled by the completion event).
+	/// When using present, it is busy from being presented until the server
+	/// sends the idle event for its pixmap.
+	/// Backed by a memfd (fd) if the server supports it, otherwise SysV shm (shmid).
+	struct Segment {
+		uint32_t seg {};
+		int fd {-1};
+		unsigned int shmid {};
+		uint8_t* data {};
+		unsigned int byteSize {};
+		nytl::Vec2ui size {}; // the size of the last contents
+		std::uint64_t presented {}; // the present count it was last presented (for age)
+		uint32_t request {}; // sequence number of the last put request
+		bool busy {};
+
+		uint32_t pixmap {}; // shm pixmap, only when using present
+		nytl::Vec2ui pixmapSize {};
+	};
+
 	void apply(const BufferGuard&) noexcept override;
 	void resize(nytl::Vec2ui size);
+	unsigned int acquireSegment();
+	bool allocate(Segment&, unsigned int byteSize);
+	bool allocateFd(Segment&, unsigned int byteSize);
+	void destroy(Segment&);
+	void applyPresent(Segment&);
+	void putImage(nytl::Span<const nytl::Rect2ui> damage);
+
+	/// Returns the size in bytes of an image row with the given width, padded
+	/// as the server expects it for images of the windows depth.
+	unsigned int stride(unsigned int width) const;
+
+	/// The default maximum number of shm segments. If all of them are busy, buffer
+	/// blocks until the server has processed the pending requests (or released
+	/// a pixmap when using present).
+	static constexpr auto defaultMaxSegments = 3u;
 
 protected:
 	X11WindowContext* windowContext_ {};
 
 	ImageFormat format_ {};
+	unsigned int scanlinePad_ {}; // in bits
 	uint32_t gc_ {};
 	bool shm_ {};
+	bool shmFd_ {}; // whether segments can be passed as fd (MIT-SHM 1.2)
+	bool present_ {}; // whether segments are presented as pixmaps
+	uint32_t presentEventID_ {};
 
 	bool active_ {};
 	nytl::Vec2ui size_; // size of active
-	unsigned int byteSize_ {}; // the size in bytes of ((shm_) ? shmaddr_ : data_)
-	uint8_t* data_ {}; // the actual data (either shmaddr or points so ownedBuffer)
+	uint8_t* data_ {}; // the actual data (either of a segment or ownedBuffer_)
 
- 	// when using shm
-	unsigned int shmid_ {};
-	uint32_t shmseg_ {};
+	// when using shm
+	std::vector<Segment> segments_;
+	unsigned int maxSegments_ {};
+	unsigned int segment_ {}; // the active segment
+	std::uint64_t presentCount_ {};
 
 	// otherwise when using owned buffer because shm not available
 	std::unique_ptr<uint8_t[]> ownedBuffer_;
+	unsigned int byteSize_ {}; // the size in bytes of ownedBuffer_
+	bool presented_ {}; // whether ownedBuffer_ holds the last presented frame
+	std::vector<uint8_t> packed_; // staging for put_image bands clipped to damage
 };
 
 /// X11 WindowContext implementation with a drawable buffer surface.
@@ -62,6 +131,8 @@ public:
 	~X11BufferWindowContext() = default;
 
 	Surface surface() override;
+	void shmCompletionEvent(uint32_t shmseg, uint32_t sequence) override;
+	void presentEvent(const x11::GenericEvent&) override;
 
 protected:
 	X11BufferSurface bufferSurface_;
@@ -13,8 +13,10 @@
 
 #include <string_view>
 #include <system_error>
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <deque>
 
 // Needed sice Xlib defines this macro
 #ifdef GenericEvent
@@ -68,6 +70,28 @@ public:
 	/// with an error_code for the cookie error and the given msg, if any.
 	void checkThrow(xcb_void_cookie_t, std::string_view msg = {}) const;
 
+	/// Registers an unchecked request whose error (if any) should be reported
+	/// asynchronously when it arrives in the event queue. Avoids the round trip
+	/// of the check functions. The context is output together with the error and
+	/// must be a string with static storage duration (e.g. a literal).
+	/// Only the most recent maxWatched requests are remembered.
+	void watch(xcb_void_cookie_t, const char* context);
+
+	/// Handles an error retrieved from the event queue. Outputs a warning with
+	/// the error and the context the failed request was registered with, if any.
+	/// Returns whether the error belonged to a watched request.
+	bool handleError(const xcb_generic_error_t&);
+
+	/// Should be called with the full sequence number of every retrieved event.
+	/// Forgets all watched requests that were processed by the server without error.
+	void processed(std::uint32_t fullSequence);
+
+	/// Whether requests should be checked synchronously instead of watched.
+	/// Useful for debugging since errors are then reported at their source.
+	/// Enabled by the X11AppContext if the NY_X11_SYNCHRONOUS env variable is set.
+	bool synchronous() const { return synchronous_; }
+	void synchronous(bool set) { synchronous_ = set; }
+
 	/// Returns the last error generated by a xlib request over the associated display.
 	std::error_code lastXlibError() const { return lastXlibError_; }
 
@@ -87,6 +111,15 @@ protected:
 	Display* xDisplay_ {}; // Needed to obtain the error message
 	xcb_connection_t* xConnection_ {};
 	std::error_code lastXlibError_ {0, *this};
+
+	static constexpr auto maxWatched = 1024u;
+	struct Watched {
+		std::uint32_t sequence;
+		const char* context;
+	};
+
+	std::deque<Watched> watched_;
+	bool synchronous_ {};
 };
 
 /// Returns the MouseButton enumeration value for the given x11 button id.
@@ -164,7 +197,14 @@ std::string errorMessage(Display&, unsigned int error);
 /// Tries to convert the given visual description with the given depth to an ImageDataFormat
 /// enumeration value. If there is no corresponding ImageDataFormat value, returns
 /// imageFormats::none.
-ImageFormat visualToFormat(const xcb_visualtype_t& visual, unsigned int depth);
+/// \param bpp The bits per pixel the server uses for images of the given depth,
+/// see bitsPerPixel. E.g. depth 24 with 32 bpp results in xrgb8888 (not argb8888).
+ImageFormat visualToFormat(const xcb_visualtype_t& visual, unsigned int depth,
+	unsigned int bpp);
+
+/// Returns the bits per pixel the server uses for images of the given depth.
+/// Returns zero if the server does not support the depth.
+unsigned int bitsPerPixel(const xcb_setup_t& setup, unsigned int depth);
 
 /// Returns the depth of the visual associated with the given id.
 /// Returns zero for unknown/invalid visuals.
@@ -17,6 +17,10 @@ class X11WindowSettings : public WindowSettings {
 public:
 	bool overrideRedirect {false};
 	uint32_t windowType {};
+
+	/// Whether a buffer surface should present its contents with the present
+	/// extension (if the server supports it), see X11BufferSurface.
+	bool bufferPresent {false};
 };
 
 /// The X11 implementation of the WindowContext interface.
@@ -63,6 +67,13 @@ public:
 	// specific event handlers
 	virtual void reparentEvent();
 
+	/// Called when the server has finished reading the shm segment for
+	/// a shm_put_image request with the given sequence number.
+	virtual void shmCompletionEvent(uint32_t shmseg, uint32_t sequence);
+
+	/// Called for events of the present extension for this window.
+	virtual void presentEvent(const x11::GenericEvent&);
+
 	X11AppContext& appContext() const { return *appContext_; } /// The associated AppContext
 	uint32_t xWindow() const { return xWindow_; } /// The underlaying x window handle
 
@@ -0,0 +1,393 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <ny/image.hpp> // ny::convertFormat, ny::premultiply, ...
+#include <ny/dataExchange.hpp> // ny::serialize, ny::deserializeImage
+
+#include <algorithm> // std::max
+#include <chrono> // std::chrono::steady_clock
+#include <cstdio> // std::printf
+#include <cstring> // std::strcmp
+#include <random> // std::mt19937
+#include <thread> // std::thread::hardware_concurrency
+#include <vector> // std::vector
+
+// Benchmarks for the ny/image functions. Does not need a display server.
+// Prints the results as one json object to stdout, containing a "results"
+// array with one entry per measured (function, parameters) combination.
+// Usage: ny-bench-image [--quick] [--filter <group>]
+//  - quick: only uses small images (except for convertFormatThreaded) and less
+//    time per measurement
+//  - filter: only runs the given group of benchmarks, one of convertFormat,
+//    convertFormatThreaded, premultiply (and unpremultiply), readPixel
+//    (and writePixel), serialize (and deserializeImage) or composite (and fill, blit)
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using ny::ImageFormat;
+
+constexpr ImageFormat formats[] = {
+	ImageFormat::rgba8888,
+	ImageFormat::argb8888,
+	ImageFormat::rgb888,
+	ImageFormat::abgr8888,
+	ImageFormat::bgra8888,
+	ImageFormat::bgr888,
+	ImageFormat::a8,
+	ImageFormat::a1,
+	ImageFormat::xrgb8888,
+	ImageFormat::xbgr8888,
+	ImageFormat::rgb565,
+	ImageFormat::xrgb2101010,
+	ImageFormat::rgba16f,
+};
+
+const char* name(ImageFormat format)
+{
+	switch(format) {
+		case ImageFormat::rgba8888: return "rgba8888";
+		case ImageFormat::argb8888: return "argb8888";
+		case ImageFormat::rgb888: return "rgb888";
+		case ImageFormat::abgr8888: return "abgr8888";
+		case ImageFormat::bgra8888: return "bgra8888";
+		case ImageFormat::bgr888: return "bgr888";
+		case ImageFormat::a8: return "a8";
+		case ImageFormat::a1: return "a1";
+		case ImageFormat::xrgb8888: return "xrgb8888";
+		case ImageFormat::xbgr8888: return "xbgr8888";
+		case ImageFormat::rgb565: return "rgb565";
+		case ImageFormat::xrgb2101010: return "xrgb2101010";
+		case ImageFormat::rgba16f: return "rgba16f";
+		default: return "none";
+	}
+}
+
+struct Settings {
+	bool quick {};
+	const char* filter {};
+	std::vector<nytl::Vec2ui> sizes;
+	std::vector<unsigned int> strideAligns; // in bits, 0 for packed
+	double minSeconds {}; // minimum time per measurement
+};
+
+// Owned image with random data.
+struct TestImage {
+	std::vector<std::uint8_t> data;
+	ny::MutableImage image;
+};
+
+TestImage createImage(nytl::Vec2ui size, ImageFormat format, unsigned int strideAlign)
+{
+	auto stride = size[0] * ny::bitSize(format);
+	if(strideAlign) stride = ny::align(stride, strideAlign);
+
+	TestImage ret;
+	ret.data.resize((std::uint64_t(stride) * size[1] + 7) / 8);
+
+	std::mt19937 rng(size[0] ^ size[1]);
+	for(auto& b : ret.data) {
+		b = rng() & 0xFFu;
+	}
+
+	ret.image = {ret.data.data(), size, format, stride};
+	return ret;
+}
+
+class Output {
+public:
+	Output() { std::printf("{\n\t\"results\": ["); }
+	~Output() { std::printf("\n\t]\n}\n"); }
+
+	// Begins a result object with the name of the measured function.
+	void begin(const char* function) {
+		std::printf("%s\n\t\t{\"function\": \"%s\"", first_ ? "" : ",", function);
+		first_ = false;
+	}
+
+	void field(const char* key, const char* value) {
+		std::printf(", \"%s\": \"%s\"", key, value);
+	}
+
+	void field(const char* key, std::uint64_t value) {
+		std::printf(", \"%s\": %llu", key, static_cast<unsigned long long>(value));
+	}
+
+	void field(const char* key, double value) {
+		std::printf(", \"%s\": %.4f", key, value);
+	}
+
+	void end() { std::printf("}"); }
+
+private:
+	bool first_ {true};
+};
+
+// Runs the given function until the minimum time is reached (at least twice)
+// and returns the average duration in seconds.
+template<typename F>
+double measure(const Settings& settings, F&& func)
+{
+	func(); // warmup
+
+	auto iterations = 0u;
+	auto start = Clock::now();
+	double elapsed;
+	do {
+		func();
+		++iterations;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while(elapsed < settings.minSeconds || iterations < 2);
+
+	return elapsed / iterations;
+}
+
+// Writes the common throughput fields of a result.
+// bytes is the number of bytes read and written by one operation.
+void throughput(Output& out, nytl::Vec2ui size, double seconds, std::uint64_t bytes)
+{
+	auto pixels = double(size[0]) * size[1];
+	out.field("width", std::uint64_t(size[0]));
+	out.field("height", std::uint64_t(size[1]));
+	out.field("nsPerOp", seconds * 1e9);
+	out.field("mpixPerSec", pixels / seconds / 1e6);
+	out.field("gbPerSec", bytes / seconds / 1e9);
+}
+
+bool enabled(const Settings& settings, const char* group)
+{
+	return !settings.filter || !std::strcmp(settings.filter, group);
+}
+
+void benchConvert(const Settings& settings, Output& out)
+{
+	for(auto size : settings.sizes) {
+		for(auto align : settings.strideAligns) {
+			for(auto from : formats) {
+				auto src = createImage(size, from, align);
+				for(auto to : formats) {
+					auto stride = size[0] * ny::bitSize(to);
+					if(align) stride = ny::align(stride, align);
+
+					std::vector<std::uint8_t> dst((std::uint64_t(stride) * size[1] + 7) / 8);
+					auto time = measure(settings, [&]{
+						ny::convertFormat(src.image, to, *dst.data(), align);
+					});
+
+					out.begin("convertFormat");
+					out.field("from", name(from));
+					out.field("to", name(to));
+					out.field("strideAlign", std::uint64_t(align));
+					throughput(out, size, time, src.data.size() + dst.size());
+					out.end();
+				}
+			}
+		}
+	}
+}
+
+// Measures the scaling of the multithreaded overloads from 1 to N threads.
+// Always uses a 4k image, also with --quick: smaller images are not split
+// up and would only measure the single-threaded path.
+void benchThreads(const Settings& settings, Output& out)
+{
+	constexpr nytl::Vec2ui size {3840u, 2160u};
+	auto hw = std::max(std::thread::hardware_concurrency(), 1u);
+
+	std::vector<unsigned int> counts;
+	for(auto i = 1u; i < hw; i *= 2) {
+		counts.push_back(i);
+	}
+	counts.push_back(hw);
+
+	auto src = createImage(size, ImageFormat::rgba8888, 0u);
+	for(auto to : {ImageFormat::bgra8888, ImageFormat::rgb888}) {
+		auto bytes = std::uint64_t(size[0]) * size[1] * ny::byteSize(to);
+		std::vector<std::uint8_t> dst(bytes);
+		for(auto threads : counts) {
+			auto time = measure(settings, [&]{
+				ny::convertFormat(src.image, to, *dst.data(), 0u, threads);
+			});
+
+			out.begin("convertFormatThreaded");
+			out.field("from", name(ImageFormat::rgba8888));
+			out.field("to", name(to));
+			out.field("threads", std::uint64_t(threads));
+			throughput(out, size, time, src.data.size() + dst.size());
+			out.end();
+		}
+	}
+
+	auto img = createImage(size, ImageFormat::argb8888, 0u);
+	for(auto threads : counts) {
+		auto time = measure(settings, [&]{ ny::premultiply(img.image, false, threads); });
+
+		out.begin("premultiplyThreaded");
+		out.field("format", name(ImageFormat::argb8888));
+		out.field("threads", std::uint64_t(threads));
+		throughput(out, size, time, 2 * img.data.size());
+		out.end();
+	}
+}
+
+void benchPremultiply(const Settings& settings, Output& out)
+{
+	for(auto size : settings.sizes) {
+		for(auto format : formats) {
+			if(!ny::alphaComponent(format)) {
+				continue;
+			}
+
+			auto img = createImage(size, format, 0u);
+			auto time = measure(settings, [&]{ ny::premultiply(img.image); });
+
+			out.begin("premultiply");
+			out.field("format", name(format));
+			throughput(out, size, time, 2 * img.data.size());
+			out.end();
+
+			time = measure(settings, [&]{ ny::unpremultiply(img.image); });
+
+			out.begin("unpremultiply");
+			out.field("format", name(format));
+			throughput(out, size, time, 2 * img.data.size());
+			out.end();
+		}
+	}
+}
+
+// readPixel/writePixel are per-pixel functions, so only smaller images are used.
+void benchPixel(const Settings& settings, Output& out)
+{
+	auto size = nytl::Vec2ui {256u, 256u};
+	for(auto format : formats) {
+		auto img = createImage(size, format, 0u);
+
+		unsigned int sum = 0u;
+		auto time = measure(settings, [&]{
+			for(auto y = 0u; y < size[1]; ++y) {
+				for(auto x = 0u; x < size[0]; ++x) {
+					sum += ny::readPixel(img.image, {x, y})[3];
+				}
+			}
+		});
+
+		out.begin("readPixel");
+		out.field("format", name(format));
+		out.field("checksum", std::uint64_t(sum));
+		throughput(out, size, time, img.data.size());
+		out.end();
+
+		time = measure(settings, [&]{
+			for(auto y = 0u; y < size[1]; ++y) {
+				for(auto x = 0u; x < size[0]; ++x) {
+					auto v = std::uint8_t(x ^ y);
+					ny::writePixel(img.image, {x, y}, {v, v, v, v});
+				}
+			}
+		});
+
+		out.begin("writePixel");
+		out.field("format", name(format));
+		throughput(out, size, time, img.data.size());
+		out.end();
+	}
+}
+
+void benchSerialize(const Settings& settings, Output& out)
+{
+	for(auto size : settings.sizes) {
+		auto img = createImage(size, ImageFormat::rgba8888, 0u);
+
+		std::vector<std::uint8_t> buffer;
+		auto time = measure(settings, [&]{ buffer = ny::serialize(img.image); });
+
+		out.begin("serialize");
+		out.field("format", name(img.image.format));
+		throughput(out, size, time, img.data.size() + buffer.size());
+		out.end();
+
+		time = measure(settings, [&]{
+			auto deserialized = ny::deserializeImage({buffer.data(), buffer.size()});
+			(void) deserialized;
+		});
+
+		out.begin("deserializeImage");
+		out.field("format", name(img.image.format));
+		throughput(out, size, time, img.data.size() + buffer.size());
+		out.end();
+	}
+}
+
+void benchComposite(const Settings& settings, Output& out)
+{
+	for(auto size : settings.sizes) {
+		auto src = createImage(size, ImageFormat::argb8888, 0u);
+		ny::premultiply(src.image);
+
+		for(auto format : {ImageFormat::argb8888, ImageFormat::xrgb8888, ImageFormat::rgb565}) {
+			auto dst = createImage(size, format, 0u);
+			auto time = measure(settings, [&]{
+				ny::fill(dst.image, {255u, 255u, 255u, 255u});
+			});
+
+			out.begin("fill");
+			out.field("format", name(format));
+			throughput(out, size, time, dst.data.size());
+			out.end();
+
+			time = measure(settings, [&]{ ny::blit(src.image, dst.image, {0, 0}); });
+
+			out.begin("blit");
+			out.field("from", name(ImageFormat::argb8888));
+			out.field("to", name(format));
+			throughput(out, size, time, src.data.size() + dst.data.size());
+			out.end();
+
+			time = measure(settings, [&]{ ny::composite(src.image, dst.image, {0, 0}); });
+
+			out.begin("composite");
+			out.field("from", name(ImageFormat::argb8888));
+			out.field("to", name(format));
+			throughput(out, size, time, src.data.size() + 2 * dst.data.size());
+			out.end();
+		}
+	}
+}
+
+} // anonymous util namespace
+
+int main(int argc, char** argv)
+{
+	Settings settings;
+	for(auto i = 1; i < argc; ++i) {
+		if(!std::strcmp(argv[i], "--quick")) {
+			settings.quick = true;
+		} else if(!std::strcmp(argv[i], "--filter") && i + 1 < argc) {
+			settings.filter = argv[++i];
+		} else {
+			std::fprintf(stderr, "usage: %s [--quick] [--filter <group>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	settings.sizes = {{32u, 32u}, {256u, 256u}, {1920u, 1080u}};
+	settings.strideAligns = {0u, 32u, 512u};
+	settings.minSeconds = 0.02;
+	if(settings.quick) {
+		settings.sizes.resize(2);
+		settings.minSeconds = 0.002;
+	} else {
+		settings.sizes.push_back({3840u, 2160u});
+		settings.sizes.push_back({7680u, 4320u});
+	}
+
+	Output out;
+	if(enabled(settings, "convertFormat")) benchConvert(settings, out);
+	if(enabled(settings, "convertFormatThreaded")) benchThreads(settings, out);
+	if(enabled(settings, "premultiply")) benchPremultiply(settings, out);
+	if(enabled(settings, "readPixel")) benchPixel(settings, out);
+	if(enabled(settings, "serialize")) benchSerialize(settings, out);
+	if(enabled(settings, "composite")) benchComposite(settings, out);
+}
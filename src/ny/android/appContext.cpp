@@ -207,6 +207,7 @@ bool AndroidAppContext::pollEvents()
 		dlg_warn("ALooper_pollOnce: I/O error");
 	}
 
+	dispatchPosted();
 	return (nativeActivity_);
 }
 
@@ -230,6 +231,7 @@ bool AndroidAppContext::waitEvents()
 		dlg_warn("ALooper_pollAll: I/O error");
 	}
 
+	dispatchPosted();
 	return (nativeActivity_);
 }
 
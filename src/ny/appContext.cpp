@@ -0,0 +1,76 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <ny/appContext.hpp>
+#include <memory> // std::unique_ptr
+
+namespace ny {
+
+struct AppContext::PostedTask {
+	std::function<void()> func;
+	PostedTask* next;
+};
+
+AppContext::~AppContext()
+{
+	for(auto list : {posted_.load(), unfinished_}) {
+		while(list) {
+			std::unique_ptr<PostedTask> task(list);
+			list = task->next;
+		}
+	}
+}
+
+void AppContext::post(std::function<void()> func)
+{
+	// push onto the stack. Multiple threads may post at the same time but
+	// only the dispatching thread takes tasks (all at once), so there is no aba problem
+	auto task = new PostedTask {std::move(func), nullptr};
+	auto next = posted_.load(std::memory_order_relaxed);
+	do {
+		task->next = next;
+	} while(!posted_.compare_exchange_weak(next, task,
+		std::memory_order_release, std::memory_order_relaxed));
+
+	// only wake up if the queue was empty, otherwise the loop was already
+	// woken up and has not yet dispatched the tasks
+	if(!next) {
+		wakeupWait();
+	}
+}
+
+void AppContext::dispatchPosted()
+{
+	// take all posted tasks at once, reverse them into the order they were posted
+	auto task = posted_.exchange(nullptr, std::memory_order_acquire);
+	PostedTask* list {};
+	while(task) {
+		auto next = task->next;
+		task->next = list;
+		list = task;
+		task = next;
+	}
+
+	// append them to the unfinished ones. We always take the tasks from unfinished_
+	// instead of a local list, so a throwing task or dispatching from within
+	// a task (e.g. by calling pollEvents) works as expected
+	if(!unfinished_) {
+		unfinished_ = list;
+	} else {
+		auto last = unfinished_;
+		while(last->next) {
+			last = last->next;
+		}
+
+		last->next = list;
+	}
+
+	while(unfinished_) {
+		std::unique_ptr<PostedTask> current(unfinished_);
+		unfinished_ = current->next;
+		current->func();
+	}
+}
+
+} // namespace ny
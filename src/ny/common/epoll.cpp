@@ -0,0 +1,291 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <ny/common/epoll.hpp>
+#include <dlg/dlg.hpp>
+
+#include <sys/epoll.h> // epoll_*
+#include <sys/timerfd.h> // timerfd_*
+#include <poll.h> // POLLIN, POLLOUT
+#include <fcntl.h> // fcntl, F_DUPFD_CLOEXEC
+#include <unistd.h> // close
+#include <errno.h> // errno
+
+#include <algorithm> // std::find_if, std::min, std::max
+#include <climits> // INT_MAX
+#include <cstdint> // std::uintptr_t
+#include <cstring> // std::strerror
+#include <stdexcept> // std::runtime_error
+#include <string> // std::string
+
+namespace ny {
+
+// the callbacks receive and register poll events, they are passed through as is
+static_assert(POLLIN == EPOLLIN && POLLPRI == EPOLLPRI && POLLOUT == EPOLLOUT);
+static_assert(POLLERR == EPOLLERR && POLLHUP == EPOLLHUP);
+
+EpollLoop::EpollLoop()
+{
+	fd_ = epoll_create1(EPOLL_CLOEXEC);
+	if(fd_ < 0) {
+		auto msg = std::string("ny::EpollLoop: epoll_create1 failed: ") + std::strerror(errno);
+		throw std::runtime_error(msg);
+	}
+}
+
+EpollLoop::~EpollLoop()
+{
+	for(auto& entry : entries_) {
+		if(entry.registered >= 0) {
+			close(entry.registered);
+		}
+	}
+
+	if(fd_ >= 0) {
+		close(fd_);
+	}
+}
+
+nytl::Connection EpollLoop::add(int fd, unsigned int events, const Callback& callback)
+{
+	// Every callback is registered for its own duplicate of the fd.
+	// epoll registrations belong to the file and only go away when all its fds
+	// are closed, so disconnect must remove them using an fd we own: the caller
+	// might already have closed its fd (or the number was reused).
+	// This also allows multiple callbacks for one fd.
+	auto registered = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if(registered < 0) {
+		auto msg = std::string("ny::EpollLoop::add: fcntl failed: ") + std::strerror(errno);
+		throw std::runtime_error(msg);
+	}
+
+	++reinterpret_cast<std::uintptr_t&>(highestID_);
+	auto& entry = entries_.emplace_back();
+	entry = {fd, registered, events, callback, highestID_, false};
+
+	epoll_event event {};
+	event.events = events;
+	event.data.ptr = &entry;
+
+	if(epoll_ctl(fd_, EPOLL_CTL_ADD, registered, &event) < 0) {
+		auto msg = std::string("ny::EpollLoop::add: epoll_ctl failed: ") + std::strerror(errno);
+		close(registered);
+		entries_.pop_back();
+		throw std::runtime_error(msg);
+	}
+
+	return {*this, highestID_};
+}
+
+bool EpollLoop::disconnect(const nytl::ConnectionID& id)
+{
+	auto it = std::find_if(entries_.begin(), entries_.end(),
+		[&](auto& entry) { return entry.id.get() == id.get() && !entry.removed; });
+	if(it == entries_.end()) {
+		return false;
+	}
+
+	if(epoll_ctl(fd_, EPOLL_CTL_DEL, it->registered, nullptr) < 0) {
+		dlg_warn("epoll_ctl(EPOLL_CTL_DEL) failed: {}", std::strerror(errno));
+	}
+
+	close(it->registered);
+	it->registered = -1;
+
+	// the ready list of a running dispatch might still reference the entry
+	// (or its callback might currently be executed), erase it later
+	if(dispatching_) {
+		it->removed = true;
+		removed_ = true;
+	} else {
+		entries_.erase(it);
+	}
+
+	return true;
+}
+
+int EpollLoop::dispatch(int timeout)
+{
+	constexpr auto maxEvents = 32u;
+	epoll_event events[maxEvents];
+
+	int ret;
+	do {
+		ret = epoll_wait(fd_, events, maxEvents, timeout);
+	} while(ret < 0 && errno == EINTR);
+
+	if(ret < 0) {
+		dlg_warn("epoll_wait failed: {}", std::strerror(errno));
+		return ret;
+	}
+
+	++dispatching_;
+	for(auto i = 0; i < ret; ++i) {
+		auto& entry = *static_cast<Entry*>(events[i].data.ptr);
+		if(entry.removed) {
+			continue;
+		}
+
+		if(!entry.callback(entry.fd, events[i].events)) {
+			disconnect(entry.id);
+		}
+	}
+
+	// erase the entries disconnected while dispatching
+	if(--dispatching_ == 0 && removed_) {
+		entries_.remove_if([](auto& entry) { return entry.removed; });
+		removed_ = false;
+	}
+
+	return ret;
+}
+
+// TimerQueue
+TimerQueue::TimerQueue(EpollLoop& loop)
+{
+	fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if(fd_ < 0) {
+		auto msg = std::string("ny::TimerQueue: timerfd_create failed: ") + std::strerror(errno);
+		throw std::runtime_error(msg);
+	}
+
+	// the loop must outlive the queue, the connection is therefore never disconnected
+	loop.add(fd_, POLLIN, [this](int, unsigned int) {
+		std::uint64_t expirations;
+		::read(fd_, &expirations, 8);
+		dispatch();
+		return true;
+	});
+}
+
+TimerQueue::~TimerQueue()
+{
+	if(fd_ >= 0) {
+		close(fd_);
+	}
+}
+
+nytl::Connection TimerQueue::add(Clock::duration duration, bool repeat,
+	const Callback& callback)
+{
+	if(repeat && duration <= Clock::duration::zero()) {
+		throw std::logic_error("ny::TimerQueue::add: repeating timer without interval");
+	}
+
+	++reinterpret_cast<std::uintptr_t&>(highestID_);
+	timers_.push_back({Clock::now() + duration, duration, repeat, callback,
+		highestID_, false});
+
+	arm();
+	return {*this, highestID_};
+}
+
+bool TimerQueue::disconnect(const nytl::ConnectionID& id)
+{
+	auto it = std::find_if(timers_.begin(), timers_.end(),
+		[&](auto& timer) { return timer.id.get() == id.get() && !timer.removed; });
+	if(it == timers_.end()) {
+		return false;
+	}
+
+	// the timer might currently be triggered, erase it later
+	if(dispatching_) {
+		it->removed = true;
+		removed_ = true;
+	} else {
+		timers_.erase(it);
+	}
+
+	arm();
+	return true;
+}
+
+void TimerQueue::dispatch()
+{
+	// Only the timers existing at the beginning are checked, the callbacks
+	// may add new ones. Removed timers are not erased while dispatching
+	++dispatching_;
+	auto now = Clock::now();
+	auto count = timers_.size();
+	auto it = timers_.begin();
+	for(auto i = 0u; i < count; ++i, ++it) {
+		auto& timer = *it;
+		if(timer.removed || timer.due > now) {
+			continue;
+		}
+
+		if(timer.repeat) {
+			// skip the intervals we missed
+			timer.due += timer.interval;
+			if(timer.due <= now) {
+				timer.due = now + timer.interval;
+			}
+		} else {
+			timer.removed = true;
+			removed_ = true;
+		}
+
+		timer.callback();
+	}
+
+	if(--dispatching_ == 0 && removed_) {
+		timers_.remove_if([](auto& timer) { return timer.removed; });
+		removed_ = false;
+	}
+
+	arm();
+}
+
+void TimerQueue::arm()
+{
+	// the first due timer and the last one that is due within
+	// slack after it, the timerfd is armed for the latter
+	auto first = Clock::time_point::max();
+	for(auto& timer : timers_) {
+		if(!timer.removed) {
+			first = std::min(first, timer.due);
+		}
+	}
+
+	itimerspec its {};
+	if(first != Clock::time_point::max()) {
+		auto last = first;
+		for(auto& timer : timers_) {
+			if(!timer.removed && timer.due <= first + slack) {
+				last = std::max(last, timer.due);
+			}
+		}
+
+		// an absolute time of zero disarms the timerfd
+		using namespace std::chrono;
+		auto ns = duration_cast<nanoseconds>(last.time_since_epoch()).count();
+		ns = std::max<decltype(ns)>(ns, 1);
+		its.it_value.tv_sec = ns / 1000000000;
+		its.it_value.tv_nsec = ns % 1000000000;
+	}
+
+	// steady_clock uses CLOCK_MONOTONIC as well
+	if(timerfd_settime(fd_, TFD_TIMER_ABSTIME, &its, nullptr) < 0) {
+		dlg_warn("timerfd_settime failed: {}", std::strerror(errno));
+	}
+}
+
+int timeout(std::chrono::steady_clock::time_point deadline)
+{
+	using namespace std::chrono;
+	if(deadline == steady_clock::time_point::max()) {
+		return -1;
+	}
+
+	auto remaining = deadline - steady_clock::now();
+	if(remaining <= steady_clock::duration::zero()) {
+		return 0;
+	}
+
+	remaining = std::min<steady_clock::duration>(remaining, milliseconds(INT_MAX));
+	auto ms = ceil<milliseconds>(remaining);
+	return static_cast<int>(ms.count());
+}
+
+} // namespace ny
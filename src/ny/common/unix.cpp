@@ -9,6 +9,11 @@
 #include <dlg/dlg.hpp>
 #include <cstring>
 
+#include <fcntl.h> // fcntl, F_ADD_SEALS
+#include <sys/mman.h> // memfd_create
+#include <unistd.h> // ftruncate, close
+#include <errno.h> // errno, ENOSYS
+
 namespace ny {
 
 // https://www.freedesktop.org/wiki/Specifications/cursor-spec/
@@ -97,4 +102,30 @@ MouseButton linuxToButton(unsigned int buttoncode) {
 	}
 }
 
+int createMemfd(const char* name, std::size_t size) {
+#if defined(MFD_CLOEXEC) && defined(MFD_ALLOW_SEALING)
+	int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(fd < 0) {
+		return -1;
+	}
+
+	if(ftruncate(fd, size) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	// sealing is not supported by all kernels, not critical
+	if(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+		dlg_debug("createMemfd: sealing failed: {}", std::strerror(errno));
+	}
+
+	return fd;
+#else
+	(void) name;
+	(void) size;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 } // namespace ny
@@ -35,6 +35,12 @@ const DataFormat DataFormat::image {"image/x-ny-data", {"ny::Image"}};
 
 std::vector<uint8_t> serialize(const Image& image)
 {
+	// the serialized data always starts at a byte, views with a bit offset
+	// (see subImage) are therefore serialized from a packed copy
+	if(image.bitOffset) {
+		return serialize(convertFormat(image, image.format));
+	}
+
 	std::vector<uint8_t> ret;
 
 	// format
@@ -79,7 +85,7 @@ UniqueImage deserializeImage(nytl::Span<const uint8_t> buffer)
 		return {};
 	}
 
-	image.data = std::make_unique<uint8_t[]>(dSize);
+	image.data = allocateImageData(dSize);
 	std::memcpy(image.data.get(), &buffer[headerSize], dSize);
 
 	return image;
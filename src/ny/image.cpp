@@ -3,23 +3,30 @@
 // See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
 
 #include <ny/image.hpp>
+#include <ny/formatTraits.hpp>
+#include <ny/imageKernels.hpp>
+#include <ny/workerPool.hpp>
 
-#include <array> // std::array
+#include <algorithm> // std::min, std::max
 #include <cmath> // std::ceil
+#include <cstdint> // std::uint64_t
+#include <stdexcept> // std::logic_error
+#include <thread> // std::thread::hardware_concurrency
+#include <vector> // std::vector
 
 // NOTE on implementation:
-// Due to the wanted simplicity of ny/image most of the functions here
-// are implemented with hardcoded format switches.
-// Most functions must be changed when additional formats are introduced.
 // There exist a (rather complex) ny/image implementation (removed 02.05.2017) that
 // implements the functions only by a meta-description of formats, which was removed
 // due to being over-designed for the needs of ny, rather error-prone and not well tested.
+// The functions here were then implemented with hardcoded format switches.
+// Now, every format is described once (detail::describe in ny/formatTraits.hpp)
+// with a fixed, simple layout (channels at word shifts) and the functions are
+// implemented as templates on FormatTraits, instantiated once per format (visitFormat).
 //
-// Functions to be changed when adding a new format include
-// - toggleWordOrder
-// - {bit,byte}Size
-// - {read/write}Pixel (only the bitOffset versions)
-//   - may need huge changed for not bit or byte aligned formats
+// Things to be changed when adding a new format include
+// - detail::describe and visitFormat (ny/formatTraits.hpp)
+// - formatCount in imageKernels.cpp (if it is the last enum value)
+// - FormatTraits::{load, store} for new pixel sizes
 // - norm
 //
 // When functions with a color precision higher than 8 bits are added, the
@@ -27,39 +34,87 @@
 // value (32 or 64 bits).
 
 namespace ny {
+namespace {
+
+// Images with less pixels are not worth splitting up, the synchronization
+// overhead would be higher than the gain.
+constexpr auto minParallelPixels = 512u * 512u;
+
+// Calls func(begin, end) for bands of rows that together cover [0, height).
+// Uses at most the given number of threads (0 for all available).
+// The worker pool is only created once an image is actually split up, so
+// the single-threaded calls don't start any threads.
+template<typename F>
+void forRowBands(nytl::Vec2ui size, unsigned int threads, F&& func)
+{
+	if(!threads) {
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
 
-bool littleEndian()
+	if(std::uint64_t(size[0]) * size[1] < minParallelPixels) {
+		threads = 1u;
+	}
+
+	auto bands = std::min(threads, size[1]);
+	if(bands <= 1) {
+		func(0u, size[1]);
+		return;
+	}
+
+	// the pool works on at most concurrency() bands at once, but the
+	// split only depends on the requested number of threads
+	detail::WorkerPool::instance().run(bands, [&](unsigned int band) {
+		auto begin = std::uint64_t(size[1]) * band / bands;
+		auto end = std::uint64_t(size[1]) * (band + 1) / bands;
+		func(unsigned(begin), unsigned(end));
+	});
+}
+
+// Returns the bit at which the given row of the image begins, relative to its data.
+template<typename P>
+std::uint64_t rowBit(const BasicImage<P>& img, unsigned int y)
 {
-	// Runtime test checking for little endianess.
-	constexpr uint32_t dummy = 1u;
-	return ((reinterpret_cast<const uint8_t*>(&dummy))[0] == 1);
+	return img.bitOffset + std::uint64_t(y) * bitStride(img);
 }
 
-unsigned int bitSize(ImageFormat format)
+// The regions of a source and destination image that overlap when the source
+// is placed at the given position in the destination.
+struct Overlap {
+	nytl::Vec2ui src;
+	nytl::Vec2ui dst;
+	nytl::Vec2ui size;
+};
+
+// Returns false if the images don't overlap.
+bool overlap(nytl::Vec2ui srcSize, nytl::Vec2ui dstSize, nytl::Vec2i pos, Overlap& ret)
 {
-	using Format = ImageFormat;
-	switch(format) {
-		case Format::rgba8888:
-		case Format::argb8888:
-		case Format::abgr8888:
-		case Format::bgra8888:
-			return 32u;
+	for(auto i = 0u; i < 2u; ++i) {
+		auto begin = std::max<std::int64_t>(pos[i], 0);
+		auto end = std::min<std::int64_t>(std::int64_t(pos[i]) + srcSize[i], dstSize[i]);
+		if(begin >= end) {
+			return false;
+		}
 
-		case Format::rgb888:
-		case Format::bgr888:
-			return 24u;
+		ret.dst[i] = begin;
+		ret.src[i] = begin - pos[i];
+		ret.size[i] = end - begin;
+	}
 
-		case Format::a8:
-			return 8u;
+	return true;
+}
 
-		case Format::a1:
-			return 1u;
+} // anonymous util namespace
 
-		case Format::none: return 0u;
-	}
+bool littleEndian()
+{
+	// Runtime test checking for little endianess.
+	constexpr uint32_t dummy = 1u;
+	return ((reinterpret_cast<const uint8_t*>(&dummy))[0] == 1);
+}
 
-	// should not be reached
-	return 0u;
+unsigned int bitSize(ImageFormat format)
+{
+	return visitFormat(format, [](auto traits) { return traits.bitSize; });
 }
 
 unsigned int byteSize(ImageFormat format)
@@ -67,89 +122,28 @@ unsigned int byteSize(ImageFormat format)
 	return std::ceil(bitSize(format) / 8.0);
 }
 
-ImageFormat toggleByteWordOrder(ImageFormat format)
+ImageFormat toggleByteWordOrder(const ImageFormat& format)
 {
-	if(!littleEndian()) return format;
-
-	using Format = ImageFormat;
-	switch(format) {
-		case Format::rgba8888: return Format::abgr8888;
-		case Format::argb8888: return Format::bgra8888;
-		case Format::abgr8888: return Format::rgba8888;
-		case Format::bgra8888: return Format::argb8888;
-		case Format::rgb888: return Format::bgr888;
-		case Format::bgr888: return Format::rgb888;
-		case Format::a8:
-		case Format::a1:
-		case Format::none: return format;
-	}
-
-	// should not be reached
-	return Format::none;
+	return visitFormat(format, [](auto traits) { return traits.byteOrder; });
 }
 
 unsigned int pixelBit(const Image& image, nytl::Vec2ui pos)
 {
-	return image.stride * pos[1] + bitSize(image.format) * pos[0];
+	return rowBit(image, pos[1]) + bitSize(image.format) * pos[0];
 }
 
 nytl::Vec4u8 readPixel(const uint8_t& pixel, ImageFormat format, unsigned int bitOffset)
 {
-	unsigned int bytesToLoad = byteSize(format); // NOTE: must be changed for [2,7]-bit formats
-	std::array<uint8_t, 4> bytes {};
-
-	// logical word-order bytes
-	bytes[0] = *(&pixel + (littleEndian() ? bytesToLoad - 1 : 0));
-	if(bytesToLoad > 1) bytes[1] = *(&pixel + (littleEndian() ? bytesToLoad - 2 : 1));
-	if(bytesToLoad > 2) bytes[2] = *(&pixel + (littleEndian() ? bytesToLoad - 3 : 2));
-	if(bytesToLoad > 3) bytes[3] = *(&pixel + (littleEndian() ? bytesToLoad - 4 : 3));
-
-	using Format = ImageFormat;
-	switch(format) {
-		case Format::rgba8888: return {bytes[0], bytes[1], bytes[2], bytes[3]};
-		case Format::argb8888: return {bytes[1], bytes[2], bytes[3], bytes[0]};
-		case Format::abgr8888: return {bytes[3], bytes[2], bytes[1], bytes[0]};
-		case Format::bgra8888: return {bytes[2], bytes[1], bytes[0], bytes[3]};
-
-		case Format::rgb888: return {bytes[0], bytes[1], bytes[2], 0};
-		case Format::bgr888: return {bytes[2], bytes[1], bytes[0], 0};
-
-		case Format::a8: return {0, 0, 0, bytes[0]};
-		case Format::a1: return {0, 0, 0, static_cast<uint8_t>(bytes[0] & (1 << (8 - bitOffset)))};
-		case Format::none: return {};
-	}
-
-	// should not be reached
-	return {};
+	return visitFormat(format, [&](auto traits) {
+		return traits.read(&pixel, bitOffset);
+	});
 }
 
 void writePixel(uint8_t& pixel, ImageFormat format, nytl::Vec4u8 color, unsigned int bitOffset)
 {
-	unsigned int bytesToWrite = byteSize(format); // NOTE: must be changed for [2,7]-bit formats
-	std::array<uint8_t, 4> bytes {}; // word-order bytes to write
-
-	using Format = ImageFormat;
-	switch(format) {
-		case Format::rgba8888: bytes = {color[0], color[1], color[2], color[3]}; break;
-		case Format::argb8888: bytes = {color[3], color[0], color[1], color[2]}; break;
-		case Format::abgr8888: bytes = {color[3], color[2], color[1], color[0]}; break;
-		case Format::bgra8888: bytes = {color[2], color[1], color[0], color[3]}; break;
-
-		case Format::rgb888: bytes = {color[0], color[1], color[2], 0}; break;
-		case Format::bgr888: bytes = {color[2], color[1], color[0], 0}; break;
-
-		case Format::a8: bytes[3] = color[4]; break;
-		case Format::a1:
-			bytes[0] = pixel & ~(1 << (8 - bitOffset));
-		 	bytes[0] |= (color[3] & (1 << 8)) >> bitOffset;
-			break;
-		case Format::none: bytes = {};
-	}
-
-	*(&pixel + 0) = bytes[littleEndian() ? bytesToWrite - 1 : 0];
-	if(bytesToWrite > 1) *(&pixel + 1) = bytes[littleEndian() ? bytesToWrite - 2 : 1];
-	if(bytesToWrite > 2) *(&pixel + 2) = bytes[littleEndian() ? bytesToWrite - 3 : 2];
-	if(bytesToWrite > 3) *(&pixel + 3) = bytes[littleEndian() ? bytesToWrite - 4 : 3];
+	visitFormat(format, [&](auto traits) {
+		traits.write(&pixel, color, bitOffset);
+	});
 }
 
 nytl::Vec4u8 readPixel(const Image& img, nytl::Vec2ui pos)
@@ -168,7 +162,7 @@ nytl::Vec4f norm(nytl::Vec4u8 color, ImageFormat format)
 {
 	auto ret = static_cast<nytl::Vec4f>(color);
 
-	if(format == ImageFormat::a1 || format == ImageFormat::none) return ret;
+	if(format == ImageFormat::none) return ret;
 	return (1 / 255.f) * ret;
 }
 
@@ -176,80 +170,311 @@ bool satisfiesRequirements(const Image& img, ImageFormat format, unsigned int st
 {
 	auto smallestStride = img.size[0] * bitSize(format);
 	if(strideAlign) smallestStride = align(smallestStride, strideAlign);
-	return (img.format == format && bitStride(img) == smallestStride);
+	return (img.format == format && bitStride(img) == smallestStride && !img.bitOffset);
 }
 
 UniqueImage convertFormat(const Image& img, ImageFormat to, unsigned int alignNewStride)
+{
+	return convertFormat(img, to, alignNewStride, 1u);
+}
+
+UniqueImage convertFormat(const Image& img, ImageFormat to, unsigned int alignNewStride,
+		unsigned int threads)
 {
 	auto newStride = img.size[0] * bitSize(to);
 	if(alignNewStride) newStride = align(newStride, alignNewStride);
 
 	UniqueImage ret;
-	ret.data = std::make_unique<std::uint8_t[]>(std::ceil((newStride * img.size[1]) / 8.0));
+	ret.data = allocateImageData((std::uint64_t(newStride) * img.size[1] + 7) / 8);
 	ret.size = img.size;
 	ret.format = to;
 	ret.stride = newStride;
-	convertFormat(img, to, *ret.data.get(), alignNewStride);
+	convertFormat(img, to, *ret.data.get(), alignNewStride, threads);
 
 	return ret;
 }
 
 void convertFormat(const Image& img, ImageFormat to, uint8_t& into, unsigned int alignNewStride)
+{
+	convertFormat(img, to, into, alignNewStride, 1u);
+}
+
+void convertFormat(const Image& img, ImageFormat to, uint8_t& into, unsigned int alignNewStride,
+		unsigned int threads)
 {
 	if(satisfiesRequirements(img, to, alignNewStride)) {
+		// not worth splitting up, bound by memory bandwidth
 		std::memcpy(&into, img.data, dataSize(img));
 		return;
 	}
 
+	// the row converter is selected only once for all rows
+	auto convertRow = detail::convertRowFunc(img.format, to);
+	if(!convertRow) {
+		return;
+	}
+
 	auto newStride = img.size[0] * bitSize(to);
 	if(alignNewStride) newStride = align(newStride, alignNewStride);
 
-	for(auto y = 0u; y < img.size[1]; ++y) {
-		for(auto x = 0u; x < img.size[0]; ++x) {
-			auto color = readPixel(img, {x, y});
-			auto bit = y * newStride + x * bitSize(to);
-			writePixel(*(&into + bit / 8), to, color, bit % 8);
+	// if rows don't start at byte boundaries, two rows might share a byte.
+	// They can't be written concurrently then
+	if(newStride % 8) {
+		threads = 1u;
+	}
+
+	forRowBands(img.size, threads, [&](unsigned int begin, unsigned int end) {
+		for(auto y = begin; y < end; ++y) {
+			auto srcBit = rowBit(img, y);
+			auto dstBit = y * std::uint64_t(newStride);
+			convertRow(img.data + srcBit / 8, srcBit % 8, &into + dstBit / 8, dstBit % 8,
+				img.size[0]);
 		}
+	});
+}
+
+void convertFormat(const Image& src, const MutableImage& dst)
+{
+	if(src.size != dst.size) {
+		throw std::logic_error("ny::convertFormat: source and destination size differ");
+	}
+
+	auto convertRow = detail::convertRowFunc(src.format, dst.format);
+	if(!convertRow) {
+		return;
+	}
+
+	for(auto y = 0u; y < src.size[1]; ++y) {
+		auto srcBit = rowBit(src, y);
+		auto dstBit = rowBit(dst, y);
+		convertRow(src.data + srcBit / 8, srcBit % 8, dst.data + dstBit / 8, dstBit % 8,
+			src.size[0]);
 	}
 }
 
-bool alphaComponent(ImageFormat format)
+MutableImage convertFormatInPlace(const MutableImage& img, ImageFormat to)
 {
-	using Format = ImageFormat;
-	switch(format) {
-		case Format::argb8888:
-		case Format::rgba8888:
-		case Format::abgr8888:
-		case Format::bgra8888:
-			return true;
-
-		case Format::rgb888:
-		case Format::bgr888:
-		case Format::a8:
-		case Format::a1:
-		case Format::none:
-			return false;
+	if(bitSize(img.format) != bitSize(to)) {
+		throw std::logic_error("ny::convertFormatInPlace: formats have different sizes");
+	}
+
+	auto ret = img;
+	ret.format = to;
+	if(img.format == to) {
+		return ret;
+	}
+
+	auto convertRow = detail::convertRowFunc(img.format, to);
+	for(auto y = 0u; y < img.size[1]; ++y) {
+		auto bit = rowBit(img, y);
+		auto row = img.data + bit / 8;
+		convertRow(row, bit % 8, row, bit % 8, img.size[0]);
+	}
+
+	return ret;
+}
+
+UniqueImage convertFormatDithered(const Image& img, ImageFormat to,
+		unsigned int alignNewStride)
+{
+	auto newStride = img.size[0] * bitSize(to);
+	if(alignNewStride) newStride = align(newStride, alignNewStride);
+
+	UniqueImage ret;
+	ret.data = allocateImageData((std::uint64_t(newStride) * img.size[1] + 7) / 8);
+	ret.size = img.size;
+	ret.format = to;
+	ret.stride = newStride;
+	convertFormatDithered(img, ret);
+
+	return ret;
+}
+
+void convertFormatDithered(const Image& src, const MutableImage& dst)
+{
+	auto ditherRow = detail::ditherRowFunc(src.format, dst.format);
+	if(!ditherRow) {
+		convertFormat(src, dst);
+		return;
 	}
 
-	// should not be reached
-	return false;
+	if(src.size != dst.size) {
+		throw std::logic_error("ny::convertFormatDithered: source and destination size differ");
+	}
+
+	for(auto y = 0u; y < src.size[1]; ++y) {
+		auto srcBit = rowBit(src, y);
+		auto dstBit = rowBit(dst, y);
+		ditherRow(src.data + srcBit / 8, srcBit % 8, dst.data + dstBit / 8, dstBit % 8,
+			src.size[0], y);
+	}
+}
+
+bool alphaComponent(ImageFormat format)
+{
+	return visitFormat(format, [](auto traits) {
+		return traits.color && traits.alpha;
+	});
 }
 
 void premultiply(const MutableImage& img, bool resetAlpha)
 {
-	if(!alphaComponent(img.format))
+	premultiply(img, resetAlpha, 1u);
+}
+
+void premultiply(const MutableImage& img, bool resetAlpha, unsigned int threads)
+{
+	auto premultiplyRow = detail::premultiplyRowFunc(img.format, resetAlpha);
+	if(!premultiplyRow) {
+		return;
+	}
+
+	forRowBands(img.size, threads, [&](unsigned int begin, unsigned int end) {
+		for(auto y = begin; y < end; ++y) {
+			premultiplyRow(img.data + rowBit(img, y) / 8, img.size[0]);
+		}
+	});
+}
+
+void unpremultiply(const MutableImage& img)
+{
+	auto unpremultiplyRow = detail::unpremultiplyRowFunc(img.format);
+	if(!unpremultiplyRow) {
 		return;
+	}
 
 	for(auto y = 0u; y < img.size[1]; ++y) {
-		for(auto x = 0u; x < img.size[0]; ++x) {
-			auto color = readPixel(img, {x, y});
-			auto alpha = norm(color, img.format)[3];
-			color[0] *= alpha;
-			color[1] *= alpha;
-			color[2] *= alpha;
-			if(resetAlpha) color[3] = 0;
-			writePixel(img, {x, y}, color);
+		unpremultiplyRow(img.data + rowBit(img, y) / 8, img.size[0]);
+	}
+}
+
+UniqueImage convertPremultiply(const Image& img, ImageFormat to, unsigned int alignNewStride)
+{
+	auto newStride = img.size[0] * bitSize(to);
+	if(alignNewStride) newStride = align(newStride, alignNewStride);
+
+	UniqueImage ret;
+	ret.data = allocateImageData((std::uint64_t(newStride) * img.size[1] + 7) / 8);
+	ret.size = img.size;
+	ret.format = to;
+	ret.stride = newStride;
+	convertPremultiply(img, to, *ret.data.get(), alignNewStride);
+
+	return ret;
+}
+
+void convertPremultiply(const Image& img, ImageFormat to, uint8_t& into,
+		unsigned int alignNewStride)
+{
+	auto premultiplyRow = detail::premultiplyRowFunc(to, false);
+	if(!premultiplyRow) {
+		convertFormat(img, to, into, alignNewStride);
+		return;
+	}
+
+	auto convertRow = detail::convertRowFunc(img.format, to);
+	if(!convertRow) {
+		return;
+	}
+
+	auto newStride = img.size[0] * bitSize(to);
+	if(alignNewStride) newStride = align(newStride, alignNewStride);
+
+	// every row is premultiplied directly after it was converted, while
+	// it is still in cache
+	for(auto y = 0u; y < img.size[1]; ++y) {
+		auto srcBit = rowBit(img, y);
+		auto dst = &into + (y * std::uint64_t(newStride)) / 8;
+		convertRow(img.data + srcBit / 8, srcBit % 8, dst, 0u, img.size[0]);
+		premultiplyRow(dst, img.size[0]);
+	}
+}
+
+void fill(const MutableImage& img, const nytl::Rect2ui& rect, nytl::Vec4u8 color)
+{
+	auto pos = nytl::Vec2i {int(rect.position[0]), int(rect.position[1])};
+	Overlap o;
+	if(img.format == ImageFormat::none || !overlap(rect.size, img.size, pos, o)) {
+		return;
+	}
+
+	auto view = subImage(img, o.dst, o.size);
+
+	// write the first row, then copy it to all other rows
+	auto bits = bitSize(img.format);
+	auto first = view.data;
+	if(bits % 8 == 0) {
+		writePixel(*first, img.format, color);
+
+		// double the written part every time
+		auto rowSize = std::uint64_t(o.size[0]) * (bits / 8);
+		for(auto done = std::uint64_t(bits / 8); done < rowSize; done *= 2) {
+			std::memcpy(first + done, first, std::min(done, rowSize - done));
 		}
+	} else {
+		for(auto x = 0u; x < o.size[0]; ++x) {
+			writePixel(view, {x, 0u}, color);
+		}
+	}
+
+	auto copyRow = detail::convertRowFunc(img.format, img.format);
+	for(auto y = 1u; y < o.size[1]; ++y) {
+		auto bit = rowBit(view, y);
+		copyRow(first, view.bitOffset, view.data + bit / 8, bit % 8, o.size[0]);
+	}
+}
+
+void fill(const MutableImage& img, nytl::Vec4u8 color)
+{
+	fill(img, {{0u, 0u}, img.size}, color);
+}
+
+void blit(const Image& src, const MutableImage& dst, nytl::Vec2i position)
+{
+	Overlap o;
+	if(!overlap(src.size, dst.size, position, o)) {
+		return;
+	}
+
+	convertFormat(subImage(src, o.src, o.size), subImage(dst, o.dst, o.size));
+}
+
+void composite(const Image& src, const MutableImage& dst, nytl::Vec2i position,
+		CompositeOp op)
+{
+	auto opaque = visitFormat(src.format, [](auto traits) {
+		return traits.color && !traits.alpha;
+	});
+
+	if(op == CompositeOp::source || opaque) {
+		blit(src, dst, position);
+		return;
+	}
+
+	auto compositeRow = detail::compositeOverRowFunc(dst.format);
+	auto convertRow = detail::convertRowFunc(src.format, detail::compositeSourceFormat(dst.format));
+	Overlap o;
+	if(!compositeRow || !convertRow || !overlap(src.size, dst.size, position, o)) {
+		return;
+	}
+
+	auto from = subImage(src, o.src, o.size);
+	auto to = subImage(dst, o.dst, o.size);
+
+	// the source rows are only converted if needed, into a buffer that stays in cache
+	auto convert = src.format != detail::compositeSourceFormat(dst.format);
+	std::vector<std::uint8_t> row(convert ? 4 * std::uint64_t(o.size[0]) : 0u);
+
+	for(auto y = 0u; y < o.size[1]; ++y) {
+		auto srcBit = rowBit(from, y);
+		auto dstBit = rowBit(to, y);
+		auto srcRow = from.data + srcBit / 8;
+		if(convert) {
+			convertRow(srcRow, srcBit % 8, row.data(), 0u, o.size[0]);
+			srcRow = row.data();
+		}
+
+		compositeRow(srcRow, to.data + dstBit / 8, dstBit % 8, o.size[0]);
 	}
 }
 
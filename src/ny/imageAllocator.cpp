@@ -0,0 +1,128 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <ny/image.hpp>
+
+#include <algorithm> // std::clamp
+#include <array> // std::array
+#include <atomic> // std::atomic
+#include <mutex> // std::mutex
+#include <new> // ::operator new
+#include <vector> // std::vector
+
+namespace ny {
+namespace {
+
+// Allocator that keeps freed blocks for reuse. Blocks are allocated in
+// power-of-two size classes, larger allocations are not pooled.
+class PoolImageAllocator : public ImageAllocator {
+public:
+	static constexpr auto minClassShift = 6u; // 64 bytes, imageDataAlign
+	static constexpr auto maxClassShift = 22u; // 4 MiB
+	static constexpr auto classCount = maxClassShift - minClassShift + 1;
+
+	// number of free blocks kept per class: up to 1 MiB per class,
+	// but at least one and at most 64 blocks.
+	static constexpr std::size_t maxCached(unsigned int sizeClass) {
+		auto size = std::size_t(1u) << (sizeClass + minClassShift);
+		return std::clamp<std::size_t>((1024u * 1024u) / size, 1u, 64u);
+	}
+
+public:
+	~PoolImageAllocator() {
+		for(auto& blocks : free_) {
+			for(auto block : blocks) {
+				release(block);
+			}
+		}
+	}
+
+	std::uint8_t* allocate(std::size_t size) override {
+		auto sizeClass = classOf(size);
+		if(sizeClass >= classCount) {
+			return static_cast<std::uint8_t*>(::operator new(size,
+				std::align_val_t(imageDataAlign)));
+		}
+
+		{
+			std::lock_guard lock(mutex_);
+			auto& blocks = free_[sizeClass];
+			if(!blocks.empty()) {
+				auto ret = blocks.back();
+				blocks.pop_back();
+				return ret;
+			}
+		}
+
+		auto classSize = std::size_t(1u) << (sizeClass + minClassShift);
+		return static_cast<std::uint8_t*>(::operator new(classSize,
+			std::align_val_t(imageDataAlign)));
+	}
+
+	void free(std::uint8_t* data, std::size_t size) override {
+		if(!data) {
+			return;
+		}
+
+		auto sizeClass = classOf(size);
+		if(sizeClass < classCount) {
+			std::lock_guard lock(mutex_);
+			auto& blocks = free_[sizeClass];
+			if(blocks.size() < maxCached(sizeClass)) {
+				blocks.push_back(data);
+				return;
+			}
+		}
+
+		release(data);
+	}
+
+private:
+	static unsigned int classOf(std::size_t size) {
+		auto ret = 0u;
+		while((std::size_t(1u) << (ret + minClassShift)) < size && ret < classCount) {
+			++ret;
+		}
+
+		return ret;
+	}
+
+	static void release(std::uint8_t* data) {
+		::operator delete(data, std::align_val_t(imageDataAlign));
+	}
+
+private:
+	std::mutex mutex_;
+	std::array<std::vector<std::uint8_t*>, classCount> free_;
+};
+
+std::atomic<ImageAllocator*> currentAllocator {};
+
+ImageAllocator& defaultAllocator()
+{
+	// never destroyed since images might be destroyed during static destruction
+	static auto allocator = new PoolImageAllocator();
+	return *allocator;
+}
+
+} // anonymous util namespace
+
+ImageAllocator& imageAllocator()
+{
+	auto allocator = currentAllocator.load();
+	return allocator ? *allocator : defaultAllocator();
+}
+
+void imageAllocator(ImageAllocator* allocator)
+{
+	currentAllocator.store(allocator);
+}
+
+UniqueImageData allocateImageData(std::size_t size)
+{
+	auto& allocator = imageAllocator();
+	return {allocator.allocate(size), {allocator, size}};
+}
+
+} // namespace ny
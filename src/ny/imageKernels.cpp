@@ -0,0 +1,1171 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <ny/imageKernels.hpp>
+#include <ny/formatTraits.hpp>
+
+#include <algorithm> // std::min
+#include <array> // std::array
+#include <cstring> // std::memcpy
+#include <utility> // std::integer_sequence
+
+// The kernels in this file are implemented as templates on the source and destination
+// format (using FormatTraits), so that all channel shifts and byte positions are known
+// at compile time and the inner loops contain no format switches.
+// Every format pair has a scalar kernel. On x86, SSE2 is used when it is
+// part of the compile-time baseline and AVX2 is detected at runtime (the AVX2
+// kernels are compiled with a function-level target attribute, so no special
+// compiler flags are needed for this file).
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define NY_IMAGE_SSE2
+		#include <emmintrin.h>
+
+		#if defined(__GNUC__) || defined(_MSC_VER)
+			#define NY_IMAGE_AVX2
+			#include <immintrin.h>
+		#endif
+	#endif
+#endif
+
+#if defined(NY_IMAGE_AVX2) && defined(_MSC_VER) && !defined(__clang__)
+	#include <intrin.h> // __cpuid, _xgetbv
+	#define NY_TARGET_AVX2
+#elif defined(NY_IMAGE_AVX2)
+	#define NY_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace ny::detail {
+namespace {
+
+constexpr auto formatCount = static_cast<unsigned int>(ImageFormat::rgba16f) + 1;
+
+// 4x4 bayer matrix used for ordered dithering.
+constexpr std::uint8_t bayer4[4][4] = {
+	{0, 8, 2, 10},
+	{12, 4, 14, 6},
+	{3, 11, 1, 9},
+	{15, 7, 13, 5}
+};
+
+// The threshold for ordered dithering at the given position, in (0, 255).
+constexpr unsigned int ditherThreshold(unsigned int x, unsigned int y)
+{
+	return bayer4[y % 4][x % 4] * 16u + 8u;
+}
+
+// - scalar -
+// Moves all channels present in both formats to their destination position.
+// Channels with different depths are rescaled (through 8 bits, as unpack and pack).
+template<ImageFormat F, ImageFormat T>
+typename FormatTraits<T>::Word remap(typename FormatTraits<F>::Word word)
+{
+	using From = FormatTraits<F>;
+	using To = FormatTraits<T>;
+	using Word = typename To::Word;
+
+	if constexpr(From::halfFloat || To::halfFloat) {
+		return To::pack(From::unpack(word));
+	} else {
+		Word ret = 0u;
+		for(auto c = 0u; c < 4u; ++c) {
+			if(From::shifts[c] >= 0 && To::shifts[c] >= 0) {
+				auto value = detail::toUnorm8(From::channel(word, c), From::depths[c]);
+				ret |= Word(detail::fromUnorm8(value, To::depths[c])) << To::shifts[c];
+			}
+		}
+
+		return ret;
+	}
+}
+
+template<ImageFormat F, ImageFormat T>
+void convertRowScalar(const std::uint8_t* src, unsigned int srcBit,
+		std::uint8_t* dst, unsigned int dstBit, unsigned int count)
+{
+	using From = FormatTraits<F>;
+	using To = FormatTraits<T>;
+
+	auto from = RowSpan<F, const std::uint8_t*> {src, srcBit, count};
+	auto to = RowSpan<T, std::uint8_t*> {dst, dstBit, count};
+
+	for(auto i = 0u; i < count; ++i) {
+		unsigned int fbit, tbit;
+		auto s = from.pixel(i, fbit);
+		auto d = to.pixel(i, tbit);
+		To::store(d, remap<F, T>(From::load(s, fbit)), tbit);
+	}
+}
+
+template<ImageFormat F>
+void copyRow(const std::uint8_t* src, unsigned int, std::uint8_t* dst, unsigned int,
+		unsigned int count)
+{
+	std::memcpy(dst, src, count * FormatTraits<F>::byteSize);
+}
+
+// Like convertRowScalar but rounds the channels with less than 8 bits using
+// ordered dithering instead of to the nearest value.
+template<ImageFormat F, ImageFormat T>
+void ditherRowScalar(const std::uint8_t* src, unsigned int srcBit,
+		std::uint8_t* dst, unsigned int dstBit, unsigned int count, unsigned int y)
+{
+	using From = FormatTraits<F>;
+	using To = FormatTraits<T>;
+	using Word = typename To::Word;
+
+	auto from = RowSpan<F, const std::uint8_t*> {src, srcBit, count};
+	auto to = RowSpan<T, std::uint8_t*> {dst, dstBit, count};
+
+	for(auto i = 0u; i < count; ++i) {
+		unsigned int fbit, tbit;
+		auto s = from.pixel(i, fbit);
+		auto d = to.pixel(i, tbit);
+
+		auto color = From::read(s, fbit);
+		auto threshold = ditherThreshold(i, y);
+
+		Word word = To::pack(color);
+		for(auto c = 0u; c < 4u; ++c) {
+			if(To::shifts[c] >= 0 && To::depths[c] < 8) {
+				auto max = (1u << To::depths[c]) - 1;
+				auto value = (color[c] * max + threshold) / 255u;
+				word &= ~(Word(max) << To::shifts[c]);
+				word |= Word(value) << To::shifts[c];
+			}
+		}
+
+		To::store(d, word, tbit);
+	}
+}
+
+// Rounded a * b / 255 for 8-bit values, exact for all inputs.
+constexpr unsigned int mul255(unsigned int a, unsigned int b)
+{
+	auto t = a * b + 128u;
+	return (t + (t >> 8)) >> 8;
+}
+
+// Rounded c * 255 / a, clamped to 255. Returns 0 for a == 0.
+constexpr unsigned int div255(unsigned int c, unsigned int a)
+{
+	if(!a) return 0u;
+	auto ret = (c * 255u + a / 2) / a;
+	return ret > 255u ? 255u : ret;
+}
+
+// The byte offsets (in memory) of the channels of a 32-bit format.
+template<ImageFormat F>
+constexpr std::array<unsigned int, 4> channelBytes()
+{
+	using Traits = FormatTraits<F>;
+	static_assert(Traits::bitSize == 32 && Traits::byteChannels);
+	static_assert(Traits::color && Traits::alpha);
+
+	std::array<unsigned int, 4> ret {};
+	for(auto c = 0u; c < 4u; ++c) {
+		ret[c] = Traits::bytePosition(Traits::shifts[c]);
+	}
+
+	return ret;
+}
+
+template<ImageFormat F, bool ResetAlpha>
+void premultiplyRowScalar(std::uint8_t* data, unsigned int count)
+{
+	constexpr auto pos = channelBytes<F>();
+	for(auto i = 0u; i < count; ++i) {
+		auto p = data + 4 * i;
+		auto alpha = p[pos[3]];
+		for(auto c = 0u; c < 3u; ++c) {
+			p[pos[c]] = mul255(p[pos[c]], alpha);
+		}
+
+		if constexpr(ResetAlpha) p[pos[3]] = 0u;
+	}
+}
+
+template<ImageFormat F>
+void unpremultiplyRowScalar(std::uint8_t* data, unsigned int count)
+{
+	constexpr auto pos = channelBytes<F>();
+	for(auto i = 0u; i < count; ++i) {
+		auto p = data + 4 * i;
+		auto alpha = p[pos[3]];
+		if(alpha == 255u) continue;
+		for(auto c = 0u; c < 3u; ++c) {
+			p[pos[c]] = div255(p[pos[c]], alpha);
+		}
+	}
+}
+
+// The format of the source pixels passed to the over kernel for the given destination.
+// For 32-bit byte formats it has the same color byte positions as the destination,
+// the kernels for all other formats are generic.
+constexpr ImageFormat compositeFormat(ImageFormat dst)
+{
+	auto desc = describe(dst);
+	if(byteChannels(desc) && desc.bits == 32 && desc.shifts[0] >= 0) {
+		if(desc.shifts[3] >= 0) return dst;
+		if(dst == ImageFormat::xrgb8888) return ImageFormat::argb8888;
+		if(dst == ImageFormat::xbgr8888) return ImageFormat::abgr8888;
+	}
+
+	return ImageFormat::argb8888;
+}
+
+// Porter-Duff over for premultiplied 32-bit pixels with byte channels.
+// Channels the destination doesn't have (x bytes) are written as 0.
+template<ImageFormat F>
+void compositeOverRowScalar32(const std::uint8_t* src, std::uint8_t* dst, unsigned int count)
+{
+	constexpr auto pos = channelBytes<compositeFormat(F)>();
+	constexpr auto dstAlpha = FormatTraits<F>::alpha;
+
+	for(auto i = 0u; i < count; ++i) {
+		auto s = src + 4 * i;
+		auto d = dst + 4 * i;
+		auto inv = 255u - s[pos[3]];
+		for(auto c = 0u; c < 4u; ++c) {
+			auto value = s[pos[c]] + mul255(d[pos[c]], inv);
+			d[pos[c]] = value > 255u ? 255u : value;
+		}
+
+		if constexpr(!dstAlpha) d[pos[3]] = 0u;
+	}
+}
+
+// Porter-Duff over for all other formats. Destinations without alpha are opaque.
+// The destination pixels are converted in small blocks to the source format,
+// blended with its kernel and converted back, using the best available converters.
+template<ImageFormat F>
+void compositeOverRowBlocks(const std::uint8_t* src, std::uint8_t* dst, unsigned int dstBit,
+		unsigned int count)
+{
+	constexpr auto C = compositeFormat(F);
+	constexpr auto blockSize = 256u;
+
+	static const auto toBlock = convertRowFunc(F, C);
+	static const auto fromBlock = convertRowFunc(C, F);
+	static const auto over = compositeOverRowFunc(C);
+
+	auto to = RowSpan<F, std::uint8_t*> {dst, dstBit, count};
+	std::uint8_t block[4 * blockSize];
+	for(auto i = 0u; i < count; i += blockSize) {
+		auto n = std::min(blockSize, count - i);
+		unsigned int bit;
+		auto d = to.pixel(i, bit);
+
+		toBlock(d, bit, block, 0u, n);
+		over(src + 4 * i, block, 0u, n);
+		fromBlock(block, 0u, d, bit, n);
+	}
+}
+
+// (un)premultiply for float formats, in float precision.
+template<ImageFormat F, bool ResetAlpha>
+void premultiplyRowHalf(std::uint8_t* data, unsigned int count)
+{
+	using Traits = FormatTraits<F>;
+	using Word = typename Traits::Word;
+
+	for(auto i = 0u; i < count; ++i) {
+		auto p = data + i * Traits::byteSize;
+		auto word = Traits::load(p);
+		auto alpha = detail::halfToFloat(Traits::channel(word, 3));
+
+		Word ret = 0u;
+		for(auto c = 0u; c < 3u; ++c) {
+			auto value = detail::halfToFloat(Traits::channel(word, c)) * alpha;
+			ret |= Word(detail::floatToHalf(value)) << Traits::shifts[c];
+		}
+
+		if constexpr(!ResetAlpha) ret |= Word(Traits::channel(word, 3)) << Traits::shifts[3];
+		Traits::store(p, ret);
+	}
+}
+
+template<ImageFormat F>
+void unpremultiplyRowHalf(std::uint8_t* data, unsigned int count)
+{
+	using Traits = FormatTraits<F>;
+	using Word = typename Traits::Word;
+
+	for(auto i = 0u; i < count; ++i) {
+		auto p = data + i * Traits::byteSize;
+		auto word = Traits::load(p);
+		auto alpha = detail::halfToFloat(Traits::channel(word, 3));
+
+		Word ret = Word(Traits::channel(word, 3)) << Traits::shifts[3];
+		for(auto c = 0u; c < 3u; ++c) {
+			auto value = 0.f;
+			if(alpha != 0.f) value = detail::halfToFloat(Traits::channel(word, c)) / alpha;
+			ret |= Word(detail::floatToHalf(value)) << Traits::shifts[c];
+		}
+
+		Traits::store(p, ret);
+	}
+}
+
+// - sse2 -
+#ifdef NY_IMAGE_SSE2
+
+template<int From, int To>
+__m128i channelSse2(__m128i v)
+{
+	if constexpr(From < 0 || To < 0) {
+		return _mm_setzero_si128();
+	} else {
+		auto mask = _mm_set1_epi32(static_cast<int>(0xFFu << To));
+		if constexpr(To > From) return _mm_and_si128(_mm_slli_epi32(v, To - From), mask);
+		else if constexpr(To < From) return _mm_and_si128(_mm_srli_epi32(v, From - To), mask);
+		else return _mm_and_si128(v, mask);
+	}
+}
+
+// Remaps four 32-bit pixels.
+template<ImageFormat F, ImageFormat T>
+__m128i remapSse2(__m128i v)
+{
+	using From = FormatTraits<F>;
+	using To = FormatTraits<T>;
+
+	auto r = channelSse2<From::shifts[0], To::shifts[0]>(v);
+	auto g = channelSse2<From::shifts[1], To::shifts[1]>(v);
+	auto b = channelSse2<From::shifts[2], To::shifts[2]>(v);
+	auto a = channelSse2<From::shifts[3], To::shifts[3]>(v);
+	return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+}
+
+// Converts 32-bit lanes holding 8-bit values to the given depth, i.e.
+// computes floor((v * max + bias) / 255) using (t + (t >> 8)) >> 8 for
+// t = v * max + bias + 1, which is exact for t < 65536.
+// Rounds to the nearest value for bias 127, see detail::fromUnorm8.
+template<unsigned int Depth>
+__m128i fromUnorm8Sse2(__m128i v, __m128i bias)
+{
+	constexpr auto max = static_cast<int>((1u << Depth) - 1);
+	auto t = _mm_mullo_epi16(v, _mm_set1_epi32(max)); // fits into 16 bits
+	t = _mm_add_epi32(_mm_add_epi32(t, bias), _mm_set1_epi32(1));
+	return _mm_srli_epi32(_mm_add_epi32(t, _mm_srli_epi32(t, 8)), 8);
+}
+
+// Converts four 32-bit pixels of format F to 16-bit pixels of format T
+// (one per 32-bit lane). The bias is passed to fromUnorm8Sse2.
+template<ImageFormat F, ImageFormat T>
+__m128i toWord16Sse2(__m128i v, __m128i bias)
+{
+	using From = FormatTraits<F>;
+	using To = FormatTraits<T>;
+
+	const auto mask = _mm_set1_epi32(0xFF);
+	auto ret = _mm_setzero_si128();
+	if constexpr(From::shifts[0] >= 0 && To::shifts[0] >= 0) {
+		auto r = _mm_and_si128(_mm_srli_epi32(v, From::shifts[0]), mask);
+		r = fromUnorm8Sse2<To::depths[0]>(r, bias);
+		ret = _mm_or_si128(ret, _mm_slli_epi32(r, To::shifts[0]));
+	}
+	if constexpr(From::shifts[1] >= 0 && To::shifts[1] >= 0) {
+		auto g = _mm_and_si128(_mm_srli_epi32(v, From::shifts[1]), mask);
+		g = fromUnorm8Sse2<To::depths[1]>(g, bias);
+		ret = _mm_or_si128(ret, _mm_slli_epi32(g, To::shifts[1]));
+	}
+	if constexpr(From::shifts[2] >= 0 && To::shifts[2] >= 0) {
+		auto b = _mm_and_si128(_mm_srli_epi32(v, From::shifts[2]), mask);
+		b = fromUnorm8Sse2<To::depths[2]>(b, bias);
+		ret = _mm_or_si128(ret, _mm_slli_epi32(b, To::shifts[2]));
+	}
+
+	return ret;
+}
+
+// Multiplier and shift that compute the rounded division of detail::toUnorm8,
+// i.e. (x * mul) >> shift == x / max for all x = v * 255 + max / 2.
+template<unsigned int Depth>
+constexpr std::array<unsigned int, 2> toUnorm8Divisor()
+{
+	constexpr auto max = (1u << Depth) - 1;
+	for(auto shift = 8u; shift < 24u; ++shift) {
+		auto mul = ((1u << shift) + max - 1) / max;
+		auto exact = true;
+		for(auto v = 0u; v <= max; ++v) {
+			auto x = v * 255 + max / 2;
+			exact &= ((std::uint64_t(x) * mul) >> shift) == x / max;
+		}
+
+		if(exact) return {mul, shift};
+	}
+
+	return {0u, 0u};
+}
+
+// Expands a channel with the given depth (at most 8 bits) to 8 bits, like
+// detail::toUnorm8. The products fit into 16 bits, the division is done with
+// a 16x16 -> 32 bit multiplication.
+template<int Shift, unsigned int Depth>
+__m128i expandChannelSse2(__m128i v)
+{
+	constexpr auto max = static_cast<int>((1u << Depth) - 1);
+	auto c = _mm_and_si128(_mm_srli_epi32(v, Shift), _mm_set1_epi32(max));
+	if constexpr(Depth == 8) {
+		return c;
+	} else {
+		constexpr auto divisor = toUnorm8Divisor<Depth>();
+		static_assert(divisor[0] > 0 && divisor[0] < 32768);
+
+		c = _mm_mullo_epi16(c, _mm_set1_epi32(255));
+		c = _mm_add_epi32(c, _mm_set1_epi32(max / 2));
+		c = _mm_madd_epi16(c, _mm_set1_epi32(divisor[0]));
+		return _mm_srli_epi32(c, divisor[1]);
+	}
+}
+
+// Converts four 16-bit pixels of format F (one per 32-bit lane) to 32-bit pixels.
+template<ImageFormat F, ImageFormat T>
+__m128i fromWord16Sse2(__m128i v)
+{
+	using From = FormatTraits<F>;
+	using To = FormatTraits<T>;
+
+	auto ret = _mm_setzero_si128();
+	if constexpr(From::shifts[0] >= 0 && To::shifts[0] >= 0) {
+		auto r = expandChannelSse2<From::shifts[0], From::depths[0]>(v);
+		ret = _mm_or_si128(ret, _mm_slli_epi32(r, To::shifts[0]));
+	}
+	if constexpr(From::shifts[1] >= 0 && To::shifts[1] >= 0) {
+		auto g = expandChannelSse2<From::shifts[1], From::depths[1]>(v);
+		ret = _mm_or_si128(ret, _mm_slli_epi32(g, To::shifts[1]));
+	}
+	if constexpr(From::shifts[2] >= 0 && To::shifts[2] >= 0) {
+		auto b = expandChannelSse2<From::shifts[2], From::depths[2]>(v);
+		ret = _mm_or_si128(ret, _mm_slli_epi32(b, To::shifts[2]));
+	}
+
+	return ret;
+}
+
+// Packs two vectors of 32-bit lanes holding 16-bit values into 16-bit lanes.
+inline __m128i packWords16Sse2(__m128i lo, __m128i hi)
+{
+	// sign extend so the saturating pack doesn't change the values
+	lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+	hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+	return _mm_packs_epi32(lo, hi);
+}
+
+// Whether the given format pair can be converted between 32-bit pixels with
+// byte channels and 16-bit rgb pixels by convertRowSse2.
+template<ImageFormat F, ImageFormat T>
+constexpr bool word16Sse2()
+{
+	using From = FormatTraits<F>;
+	return From::byteChannels && From::bitSize == 32 && T == ImageFormat::rgb565;
+}
+
+// SSE2 has no byte shuffle, so only the formats made up of complete
+// 32-bit words (and a8, rgb565) are handled here, everything else is scalar.
+template<ImageFormat F, ImageFormat T>
+void convertRowSse2(const std::uint8_t* src, unsigned int srcBit,
+		std::uint8_t* dst, unsigned int dstBit, unsigned int count)
+{
+	using From = FormatTraits<F>;
+	using To = FormatTraits<T>;
+
+	auto i = 0u;
+	if constexpr(From::byteChannels && From::bitSize == 32 &&
+			To::byteChannels && To::bitSize == 32) {
+		for(; i + 4 <= count; i += 4) {
+			auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i), remapSse2<F, T>(v));
+		}
+	} else if constexpr(From::byteChannels && From::bitSize == 32 && From::alpha &&
+			T == ImageFormat::a8) {
+		const auto mask = _mm_set1_epi32(0xFF);
+		for(; i + 16 <= count; i += 16) {
+			auto s = reinterpret_cast<const __m128i*>(src + 4 * i);
+			__m128i v[4];
+			for(auto j = 0u; j < 4u; ++j) {
+				auto a = _mm_srli_epi32(_mm_loadu_si128(s + j), From::shifts[3]);
+				v[j] = _mm_and_si128(a, mask);
+			}
+
+			auto lo = _mm_packs_epi32(v[0], v[1]);
+			auto hi = _mm_packs_epi32(v[2], v[3]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+		}
+	} else if constexpr(F == ImageFormat::a8 && To::byteChannels && To::bitSize == 32 &&
+			To::alpha) {
+		const auto zero = _mm_setzero_si128();
+		for(; i + 16 <= count; i += 16) {
+			auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			auto lo = _mm_unpacklo_epi8(v, zero);
+			auto hi = _mm_unpackhi_epi8(v, zero);
+			__m128i w[4] = {
+				_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+				_mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)
+			};
+
+			auto d = reinterpret_cast<__m128i*>(dst + 4 * i);
+			for(auto j = 0u; j < 4u; ++j) {
+				_mm_storeu_si128(d + j, _mm_slli_epi32(w[j], To::shifts[3]));
+			}
+		}
+	} else if constexpr(word16Sse2<F, T>()) {
+		const auto bias = _mm_set1_epi32(127);
+		for(; i + 8 <= count; i += 8) {
+			auto s = reinterpret_cast<const __m128i*>(src + 4 * i);
+			auto lo = toWord16Sse2<F, T>(_mm_loadu_si128(s), bias);
+			auto hi = toWord16Sse2<F, T>(_mm_loadu_si128(s + 1), bias);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), packWords16Sse2(lo, hi));
+		}
+	} else if constexpr(word16Sse2<T, F>()) {
+		const auto zero = _mm_setzero_si128();
+		for(; i + 8 <= count; i += 8) {
+			auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+			auto d = reinterpret_cast<__m128i*>(dst + 4 * i);
+			_mm_storeu_si128(d, fromWord16Sse2<F, T>(_mm_unpacklo_epi16(v, zero)));
+			_mm_storeu_si128(d + 1, fromWord16Sse2<F, T>(_mm_unpackhi_epi16(v, zero)));
+		}
+	}
+
+	// remaining pixels
+	unsigned int fbit, tbit;
+	auto s = RowSpan<F, const std::uint8_t*> {src, srcBit, count}.pixel(i, fbit);
+	auto d = RowSpan<T, std::uint8_t*> {dst, dstBit, count}.pixel(i, tbit);
+	convertRowScalar<F, T>(s, fbit, d, tbit, count - i);
+}
+
+
+// Like toWord16Sse2 conversion in convertRowSse2 but with ordered dithering.
+// Since 4 pixels are processed at once, the dither thresholds are the same
+// for every vector of a row.
+template<ImageFormat F, ImageFormat T>
+void ditherRowSse2(const std::uint8_t* src, unsigned int srcBit,
+		std::uint8_t* dst, unsigned int dstBit, unsigned int count, unsigned int y)
+{
+	auto i = 0u;
+	if constexpr(word16Sse2<F, T>()) {
+		const auto bias = _mm_setr_epi32(ditherThreshold(0, y), ditherThreshold(1, y),
+			ditherThreshold(2, y), ditherThreshold(3, y));
+		for(; i + 8 <= count; i += 8) {
+			auto s = reinterpret_cast<const __m128i*>(src + 4 * i);
+			auto lo = toWord16Sse2<F, T>(_mm_loadu_si128(s), bias);
+			auto hi = toWord16Sse2<F, T>(_mm_loadu_si128(s + 1), bias);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), packWords16Sse2(lo, hi));
+		}
+	}
+
+	// remaining pixels. i is a multiple of 4, so the dither pattern stays the same
+	unsigned int fbit, tbit;
+	auto s = RowSpan<F, const std::uint8_t*> {src, srcBit, count}.pixel(i, fbit);
+	auto d = RowSpan<T, std::uint8_t*> {dst, dstBit, count}.pixel(i, tbit);
+	ditherRowScalar<F, T>(s, fbit, d, tbit, count - i, y);
+}
+
+// Mask of the alpha bytes of four 32-bit pixels.
+template<ImageFormat F>
+__m128i alphaMaskSse2()
+{
+	constexpr auto pos = channelBytes<F>();
+	return _mm_set1_epi32(static_cast<int>(0xFFu << (8 * pos[3])));
+}
+
+// Rounded a * b / 255 for 16-bit lanes holding 8-bit values, see mul255.
+inline __m128i mul255Sse2(__m128i a, __m128i b)
+{
+	auto t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+template<ImageFormat F, bool ResetAlpha>
+void premultiplyRowSse2(std::uint8_t* data, unsigned int count)
+{
+	constexpr auto a = static_cast<int>(channelBytes<F>()[3]);
+	constexpr auto broadcast = _MM_SHUFFLE(a, a, a, a);
+
+	const auto zero = _mm_setzero_si128();
+	const auto ones = _mm_cmpeq_epi8(zero, zero);
+	const auto alphaMask = alphaMaskSse2<F>();
+
+	auto i = 0u;
+	for(; i + 4 <= count; i += 4) {
+		auto ptr = reinterpret_cast<__m128i*>(data + 4 * i);
+		auto v = _mm_loadu_si128(ptr);
+
+		// opaque pixels are not changed
+		auto opaque = _mm_cmpeq_epi8(_mm_or_si128(v, _mm_xor_si128(alphaMask, ones)), ones);
+		if(!ResetAlpha && _mm_movemask_epi8(opaque) == 0xFFFF) {
+			continue;
+		}
+
+		auto lo = _mm_unpacklo_epi8(v, zero);
+		auto hi = _mm_unpackhi_epi8(v, zero);
+		auto alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, broadcast), broadcast);
+		auto ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, broadcast), broadcast);
+		auto res = _mm_packus_epi16(mul255Sse2(lo, alo), mul255Sse2(hi, ahi));
+
+		auto alpha = ResetAlpha ? zero : _mm_and_si128(v, alphaMask);
+		_mm_storeu_si128(ptr, _mm_or_si128(_mm_andnot_si128(alphaMask, res), alpha));
+	}
+
+	premultiplyRowScalar<F, ResetAlpha>(data + 4 * i, count - i);
+}
+
+// Divides in float, which is exact here: the rounded quotient of the
+// integers c * 255 + a / 2 and a (a >= 2) is never rounded up to the
+// next integer since both are small enough. Division by zero results in
+// an invalid integer conversion which is saturated to 0 by the packs.
+template<ImageFormat F>
+void unpremultiplyRowSse2(std::uint8_t* data, unsigned int count)
+{
+	constexpr auto a = static_cast<int>(channelBytes<F>()[3]);
+	constexpr auto broadcast = _MM_SHUFFLE(a, a, a, a);
+
+	const auto zero = _mm_setzero_si128();
+	const auto ones = _mm_cmpeq_epi8(zero, zero);
+	const auto alphaMask = alphaMaskSse2<F>();
+
+	auto i = 0u;
+	for(; i + 4 <= count; i += 4) {
+		auto ptr = reinterpret_cast<__m128i*>(data + 4 * i);
+		auto v = _mm_loadu_si128(ptr);
+
+		auto opaque = _mm_cmpeq_epi8(_mm_or_si128(v, _mm_xor_si128(alphaMask, ones)), ones);
+		if(_mm_movemask_epi8(opaque) == 0xFFFF) {
+			continue;
+		}
+
+		auto lo = _mm_unpacklo_epi8(v, zero);
+		auto hi = _mm_unpackhi_epi8(v, zero);
+		__m128i px[4] = {
+			_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+			_mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)
+		};
+
+		for(auto& p : px) {
+			auto alpha = _mm_shuffle_epi32(p, broadcast);
+			auto num = _mm_sub_epi32(_mm_slli_epi32(p, 8), p); // * 255
+			num = _mm_add_epi32(num, _mm_srli_epi32(alpha, 1));
+			auto quot = _mm_div_ps(_mm_cvtepi32_ps(num), _mm_cvtepi32_ps(alpha));
+			p = _mm_cvttps_epi32(quot);
+		}
+
+		auto res = _mm_packus_epi16(_mm_packs_epi32(px[0], px[1]),
+			_mm_packs_epi32(px[2], px[3]));
+		res = _mm_or_si128(_mm_andnot_si128(alphaMask, res), _mm_and_si128(v, alphaMask));
+		_mm_storeu_si128(ptr, res);
+	}
+
+	unpremultiplyRowScalar<F>(data + 4 * i, count - i);
+}
+
+// Porter-Duff over for 4 pixels per iteration, see compositeOverRowScalar32.
+// Completely opaque and (all zero) transparent source pixels are common (e.g.
+// text or widgets drawn on a background) and don't need the blending.
+template<ImageFormat F>
+void compositeOverRowSse2(const std::uint8_t* src, std::uint8_t* dst, unsigned int,
+		unsigned int count)
+{
+	constexpr auto C = compositeFormat(F);
+	constexpr auto a = static_cast<int>(channelBytes<C>()[3]);
+	constexpr auto broadcast = _MM_SHUFFLE(a, a, a, a);
+
+	const auto zero = _mm_setzero_si128();
+	const auto ones = _mm_cmpeq_epi8(zero, zero);
+	const auto alphaMask = alphaMaskSse2<C>();
+	const auto dstMask = FormatTraits<F>::alpha ? ones : _mm_xor_si128(alphaMask, ones);
+	const auto max = _mm_set1_epi16(255);
+
+	auto i = 0u;
+	for(; i + 4 <= count; i += 4) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i));
+		auto ptr = reinterpret_cast<__m128i*>(dst + 4 * i);
+
+		auto transparent = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) == 0xFFFF;
+		if(transparent) {
+			continue;
+		}
+
+		auto alpha = _mm_and_si128(v, alphaMask);
+		auto opaque = _mm_movemask_epi8(_mm_cmpeq_epi8(alpha, alphaMask)) == 0xFFFF;
+		if(opaque) {
+			_mm_storeu_si128(ptr, _mm_and_si128(v, dstMask));
+			continue;
+		}
+
+		auto d = _mm_loadu_si128(ptr);
+		auto lo = _mm_unpacklo_epi8(v, zero);
+		auto hi = _mm_unpackhi_epi8(v, zero);
+		auto ilo = _mm_sub_epi16(max, _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, broadcast),
+			broadcast));
+		auto ihi = _mm_sub_epi16(max, _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, broadcast),
+			broadcast));
+
+		auto dlo = mul255Sse2(_mm_unpacklo_epi8(d, zero), ilo);
+		auto dhi = mul255Sse2(_mm_unpackhi_epi8(d, zero), ihi);
+		auto res = _mm_adds_epu8(v, _mm_packus_epi16(dlo, dhi));
+		_mm_storeu_si128(ptr, _mm_and_si128(res, dstMask));
+	}
+
+	compositeOverRowScalar32<F>(src + 4 * i, dst + 4 * i, count - i);
+}
+
+#endif // NY_IMAGE_SSE2
+
+// - avx2 -
+#ifdef NY_IMAGE_AVX2
+
+// Byte shuffle mask for 4 pixels (one 128-bit lane) from F to T.
+// Destination bytes without source channel are zeroed (0x80).
+template<ImageFormat F, ImageFormat T>
+constexpr std::array<std::int8_t, 16> shuffleMask()
+{
+	using From = FormatTraits<F>;
+	using To = FormatTraits<T>;
+
+	std::array<std::int8_t, 16> ret {};
+	for(auto& val : ret) {
+		val = static_cast<std::int8_t>(0x80);
+	}
+
+	for(auto p = 0u; p < 4u; ++p) {
+		for(auto c = 0u; c < 4u; ++c) {
+			if(To::shifts[c] < 0 || From::shifts[c] < 0) {
+				continue;
+			}
+
+			auto dpos = p * To::byteSize + To::bytePosition(To::shifts[c]);
+			auto spos = p * From::byteSize + From::bytePosition(From::shifts[c]);
+			ret[dpos] = static_cast<std::int8_t>(spos);
+		}
+	}
+
+	return ret;
+}
+
+// Loads/stores 4 pixels of 3 bytes without touching any additional bytes
+NY_TARGET_AVX2 inline __m128i load12(const std::uint8_t* src)
+{
+	std::int32_t last;
+	std::memcpy(&last, src + 8, 4);
+	auto lo = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+	return _mm_unpacklo_epi64(lo, _mm_cvtsi32_si128(last));
+}
+
+NY_TARGET_AVX2 inline void store12(std::uint8_t* dst, __m128i v)
+{
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), v);
+	auto last = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+	std::memcpy(dst + 8, &last, 4);
+}
+
+// Converts between all formats with 24 or 32 bits per pixel using byte shuffles.
+// Handles 8 pixels per iteration.
+template<ImageFormat F, ImageFormat T>
+NY_TARGET_AVX2 void convertRowAvx2(const std::uint8_t* src, unsigned int srcBit,
+		std::uint8_t* dst, unsigned int dstBit, unsigned int count)
+{
+	constexpr auto fb = FormatTraits<F>::byteSize;
+	constexpr auto tb = FormatTraits<T>::byteSize;
+	static_assert((fb == 3 || fb == 4) && (tb == 3 || tb == 4));
+
+	static constexpr auto maskData = shuffleMask<F, T>();
+	auto mask128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(maskData.data()));
+	auto mask = _mm256_broadcastsi128_si256(mask128);
+
+	auto i = 0u;
+	for(; i + 8 <= count; i += 8) {
+		auto s = src + i * fb;
+		auto d = dst + i * tb;
+
+		__m256i v;
+		if constexpr(fb == 4) {
+			v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+		} else {
+			v = _mm256_castsi128_si256(load12(s));
+			v = _mm256_inserti128_si256(v, load12(s + 12), 1);
+		}
+
+		v = _mm256_shuffle_epi8(v, mask);
+
+		if constexpr(tb == 4) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(d), v);
+		} else {
+			store12(d, _mm256_castsi256_si128(v));
+			store12(d + 12, _mm256_extracti128_si256(v, 1));
+		}
+	}
+
+	convertRowSse2<F, T>(src + i * fb, srcBit, dst + i * tb, dstBit, count - i);
+}
+
+NY_TARGET_AVX2 inline __m256i mul255Avx2(__m256i a, __m256i b)
+{
+	auto t = _mm256_add_epi16(_mm256_mullo_epi16(a, b), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// Same as premultiplyRowSse2 for 8 pixels per iteration.
+// unpremultiply has no avx2 kernel since it is dominated by the division.
+template<ImageFormat F, bool ResetAlpha>
+NY_TARGET_AVX2 void premultiplyRowAvx2(std::uint8_t* data, unsigned int count)
+{
+	constexpr auto a = static_cast<int>(channelBytes<F>()[3]);
+	constexpr auto broadcast = _MM_SHUFFLE(a, a, a, a);
+
+	const auto zero = _mm256_setzero_si256();
+	const auto ones = _mm256_cmpeq_epi8(zero, zero);
+	const auto alphaMask = _mm256_set1_epi32(static_cast<int>(0xFFu << (8 * a)));
+
+	auto i = 0u;
+	for(; i + 8 <= count; i += 8) {
+		auto ptr = reinterpret_cast<__m256i*>(data + 4 * i);
+		auto v = _mm256_loadu_si256(ptr);
+
+		auto inv = _mm256_xor_si256(alphaMask, ones);
+		auto opaque = _mm256_cmpeq_epi8(_mm256_or_si256(v, inv), ones);
+		if(!ResetAlpha && _mm256_movemask_epi8(opaque) == -1) {
+			continue;
+		}
+
+		auto lo = _mm256_unpacklo_epi8(v, zero);
+		auto hi = _mm256_unpackhi_epi8(v, zero);
+		auto alo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, broadcast), broadcast);
+		auto ahi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, broadcast), broadcast);
+		auto res = _mm256_packus_epi16(mul255Avx2(lo, alo), mul255Avx2(hi, ahi));
+
+		auto alpha = ResetAlpha ? zero : _mm256_and_si256(v, alphaMask);
+		_mm256_storeu_si256(ptr, _mm256_or_si256(_mm256_andnot_si256(alphaMask, res), alpha));
+	}
+
+	premultiplyRowSse2<F, ResetAlpha>(data + 4 * i, count - i);
+}
+
+// Same as compositeOverRowSse2 for 8 pixels per iteration.
+template<ImageFormat F>
+NY_TARGET_AVX2 void compositeOverRowAvx2(const std::uint8_t* src, std::uint8_t* dst,
+		unsigned int dstBit, unsigned int count)
+{
+	constexpr auto a = static_cast<int>(channelBytes<compositeFormat(F)>()[3]);
+	constexpr auto broadcast = _MM_SHUFFLE(a, a, a, a);
+
+	const auto zero = _mm256_setzero_si256();
+	const auto ones = _mm256_cmpeq_epi8(zero, zero);
+	const auto alphaMask = _mm256_set1_epi32(static_cast<int>(0xFFu << (8 * a)));
+	const auto dstMask = FormatTraits<F>::alpha ? ones : _mm256_xor_si256(alphaMask, ones);
+	const auto max = _mm256_set1_epi16(255);
+
+	auto i = 0u;
+	for(; i + 8 <= count; i += 8) {
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 4 * i));
+		auto ptr = reinterpret_cast<__m256i*>(dst + 4 * i);
+
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) == -1) {
+			continue;
+		}
+
+		auto alpha = _mm256_and_si256(v, alphaMask);
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(alpha, alphaMask)) == -1) {
+			_mm256_storeu_si256(ptr, _mm256_and_si256(v, dstMask));
+			continue;
+		}
+
+		auto d = _mm256_loadu_si256(ptr);
+		auto lo = _mm256_unpacklo_epi8(v, zero);
+		auto hi = _mm256_unpackhi_epi8(v, zero);
+		auto alo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, broadcast), broadcast);
+		auto ahi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, broadcast), broadcast);
+
+		auto dlo = mul255Avx2(_mm256_unpacklo_epi8(d, zero), _mm256_sub_epi16(max, alo));
+		auto dhi = mul255Avx2(_mm256_unpackhi_epi8(d, zero), _mm256_sub_epi16(max, ahi));
+		auto res = _mm256_adds_epu8(v, _mm256_packus_epi16(dlo, dhi));
+		_mm256_storeu_si256(ptr, _mm256_and_si256(res, dstMask));
+	}
+
+	compositeOverRowSse2<F>(src + 4 * i, dst + 4 * i, dstBit, count - i);
+}
+
+bool cpuAvx2()
+{
+	#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 0);
+		if(info[0] < 7) return false;
+
+		// check os support for ymm registers
+		__cpuid(info, 1);
+		auto osxsave = (info[2] & (1 << 27)) != 0;
+		auto avx = (info[2] & (1 << 28)) != 0;
+		if(!osxsave || !avx || (_xgetbv(0) & 6u) != 6u) return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	#endif
+}
+
+#endif // NY_IMAGE_AVX2
+
+// - dispatch -
+using ConvertTable = std::array<std::array<ConvertRowFunc, formatCount>, formatCount>;
+
+template<ImageFormat F, ImageFormat T>
+ConvertRowFunc selectConvertRow(bool avx2)
+{
+	using From = FormatTraits<F>;
+
+	if constexpr(F == ImageFormat::none || T == ImageFormat::none) {
+		return nullptr;
+	} else if constexpr(F == T && From::bitSize % 8 == 0) {
+		return &copyRow<F>;
+	} else {
+		(void) avx2;
+
+		#ifdef NY_IMAGE_AVX2
+			using To = FormatTraits<T>;
+			constexpr auto shuffle = From::byteChannels && To::byteChannels &&
+				(From::bitSize == 24 || From::bitSize == 32) &&
+				(To::bitSize == 24 || To::bitSize == 32);
+			if constexpr(shuffle) {
+				if(avx2) return &convertRowAvx2<F, T>;
+			}
+		#endif
+
+		#ifdef NY_IMAGE_SSE2
+			return &convertRowSse2<F, T>;
+		#else
+			return &convertRowScalar<F, T>;
+		#endif
+	}
+}
+
+template<unsigned int F, unsigned int... T>
+void fillConvertRow(ConvertTable& table, bool avx2, std::integer_sequence<unsigned int, T...>)
+{
+	((table[F][T] = selectConvertRow<ImageFormat(F), ImageFormat(T)>(avx2)), ...);
+}
+
+template<unsigned int... F>
+void fillConvertTable(ConvertTable& table, bool avx2,
+		std::integer_sequence<unsigned int, F...> seq)
+{
+	(fillConvertRow<F>(table, avx2, seq), ...);
+}
+
+ConvertTable createConvertTable(bool avx2)
+{
+	ConvertTable table {};
+	fillConvertTable(table, avx2, std::make_integer_sequence<unsigned int, formatCount>());
+	return table;
+}
+
+template<ImageFormat F, ImageFormat T>
+DitherRowFunc selectDitherRow()
+{
+	using To = FormatTraits<T>;
+
+	constexpr auto lowDepth = [] {
+		for(auto c = 0u; c < 4u; ++c) {
+			if(To::shifts[c] >= 0 && To::depths[c] < 8) return true;
+		}
+		return false;
+	}();
+
+	if constexpr(F == ImageFormat::none || !To::color || !lowDepth) {
+		return nullptr;
+	} else {
+		#ifdef NY_IMAGE_SSE2
+			return &ditherRowSse2<F, T>;
+		#else
+			return &ditherRowScalar<F, T>;
+		#endif
+	}
+}
+
+using DitherTable = std::array<std::array<DitherRowFunc, formatCount>, formatCount>;
+
+template<unsigned int F, unsigned int... T>
+void fillDitherRow(DitherTable& table, std::integer_sequence<unsigned int, T...>)
+{
+	((table[F][T] = selectDitherRow<ImageFormat(F), ImageFormat(T)>()), ...);
+}
+
+template<unsigned int... F>
+DitherTable createDitherTable(std::integer_sequence<unsigned int, F...> seq)
+{
+	DitherTable table {};
+	(fillDitherRow<F>(table, seq), ...);
+	return table;
+}
+
+template<ImageFormat F, bool ResetAlpha>
+PixelRowFunc selectPremultiplyRow(bool avx2)
+{
+	using Traits = FormatTraits<F>;
+	if constexpr(!Traits::color || !Traits::alpha) {
+		return nullptr;
+	} else if constexpr(Traits::halfFloat) {
+		return &premultiplyRowHalf<F, ResetAlpha>;
+	} else {
+		(void) avx2;
+
+		#ifdef NY_IMAGE_AVX2
+			if(avx2) return &premultiplyRowAvx2<F, ResetAlpha>;
+		#endif
+
+		#ifdef NY_IMAGE_SSE2
+			return &premultiplyRowSse2<F, ResetAlpha>;
+		#else
+			return &premultiplyRowScalar<F, ResetAlpha>;
+		#endif
+	}
+}
+
+template<ImageFormat F>
+PixelRowFunc selectUnpremultiplyRow()
+{
+	using Traits = FormatTraits<F>;
+	if constexpr(!Traits::color || !Traits::alpha) {
+		return nullptr;
+	} else if constexpr(Traits::halfFloat) {
+		return &unpremultiplyRowHalf<F>;
+	} else {
+		#ifdef NY_IMAGE_SSE2
+			return &unpremultiplyRowSse2<F>;
+		#else
+			return &unpremultiplyRowScalar<F>;
+		#endif
+	}
+}
+
+template<ImageFormat F>
+CompositeRowFunc selectCompositeOverRow(bool avx2)
+{
+	using Traits = FormatTraits<F>;
+	constexpr auto byteFormat = Traits::byteChannels && Traits::bitSize == 32 && Traits::color;
+
+	if constexpr(F == ImageFormat::none) {
+		return nullptr;
+	} else if constexpr(byteFormat) {
+		(void) avx2;
+
+		#ifdef NY_IMAGE_AVX2
+			if(avx2) return &compositeOverRowAvx2<F>;
+		#endif
+
+		#ifdef NY_IMAGE_SSE2
+			return &compositeOverRowSse2<F>;
+		#else
+			return [](const std::uint8_t* src, std::uint8_t* dst, unsigned int,
+					unsigned int count) { compositeOverRowScalar32<F>(src, dst, count); };
+		#endif
+	} else {
+		return &compositeOverRowBlocks<F>;
+	}
+}
+
+struct PixelTables {
+	std::array<PixelRowFunc, formatCount> premultiply;
+	std::array<PixelRowFunc, formatCount> premultiplyReset;
+	std::array<PixelRowFunc, formatCount> unpremultiply;
+	std::array<CompositeRowFunc, formatCount> compositeOver;
+};
+
+template<unsigned int... F>
+PixelTables createPixelTables(bool avx2, std::integer_sequence<unsigned int, F...>)
+{
+	PixelTables ret;
+	ret.premultiply = {selectPremultiplyRow<ImageFormat(F), false>(avx2)...};
+	ret.premultiplyReset = {selectPremultiplyRow<ImageFormat(F), true>(avx2)...};
+	ret.unpremultiply = {selectUnpremultiplyRow<ImageFormat(F)>()...};
+	ret.compositeOver = {selectCompositeOverRow<ImageFormat(F)>(avx2)...};
+	return ret;
+}
+
+bool avx2Available()
+{
+	#ifdef NY_IMAGE_AVX2
+		static const auto avx2 = cpuAvx2();
+		return avx2;
+	#else
+		return false;
+	#endif
+}
+
+const PixelTables& pixelTables()
+{
+	static const auto tables = createPixelTables(avx2Available(),
+		std::make_integer_sequence<unsigned int, formatCount>());
+	return tables;
+}
+
+} // anonymous util namespace
+
+ConvertRowFunc convertRowFunc(ImageFormat from, ImageFormat to)
+{
+	static const auto table = createConvertTable(avx2Available());
+
+	auto f = static_cast<unsigned int>(from);
+	auto t = static_cast<unsigned int>(to);
+	if(f >= formatCount || t >= formatCount) {
+		return nullptr;
+	}
+
+	return table[f][t];
+}
+
+DitherRowFunc ditherRowFunc(ImageFormat from, ImageFormat to)
+{
+	static const auto table = createDitherTable(
+		std::make_integer_sequence<unsigned int, formatCount>());
+
+	auto f = static_cast<unsigned int>(from);
+	auto t = static_cast<unsigned int>(to);
+	if(f >= formatCount || t >= formatCount) {
+		return nullptr;
+	}
+
+	return table[f][t];
+}
+
+PixelRowFunc premultiplyRowFunc(ImageFormat format, bool resetAlpha)
+{
+	auto f = static_cast<unsigned int>(format);
+	if(f >= formatCount) {
+		return nullptr;
+	}
+
+	auto& tables = pixelTables();
+	return resetAlpha ? tables.premultiplyReset[f] : tables.premultiply[f];
+}
+
+PixelRowFunc unpremultiplyRowFunc(ImageFormat format)
+{
+	auto f = static_cast<unsigned int>(format);
+	if(f >= formatCount) {
+		return nullptr;
+	}
+
+	return pixelTables().unpremultiply[f];
+}
+
+ImageFormat compositeSourceFormat(ImageFormat dst)
+{
+	return compositeFormat(dst);
+}
+
+CompositeRowFunc compositeOverRowFunc(ImageFormat dst)
+{
+	auto f = static_cast<unsigned int>(dst);
+	if(f >= formatCount) {
+		return nullptr;
+	}
+
+	return pixelTables().compositeOver[f];
+}
+
+} // namespace ny::detail
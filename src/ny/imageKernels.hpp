@@ -0,0 +1,69 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <ny/image.hpp>
+#include <cstdint> // std::uint8_t
+
+// Internal row kernels used by the ny/image functions.
+// They are selected once per call (not per pixel) and operate on
+// complete image rows, so they can be vectorized.
+
+namespace ny::detail {
+
+/// Converts count pixels from one format to another.
+/// The given bit offsets are the positions of the first pixel inside the first byte
+/// (counted from the most significant bit) and will always be 0 for formats
+/// whose bitSize is a multiple of 8. Pixels beyond count are never touched.
+/// For different formats with the same bitSize, src and dst may be the same
+/// (every pixel block is completely read before it is written).
+using ConvertRowFunc = void(*)(const std::uint8_t* src, unsigned int srcBit,
+	std::uint8_t* dst, unsigned int dstBit, unsigned int count);
+
+/// Returns the best available row converter for the given format pair.
+/// The dispatch table is built on first use, depending on the instruction
+/// sets supported by the cpu. Returns nullptr if any of the formats is none.
+ConvertRowFunc convertRowFunc(ImageFormat from, ImageFormat to);
+
+/// Like ConvertRowFunc but uses ordered dithering for destination channels
+/// with less than 8 bits. y is the row of the image, it selects the dither pattern.
+using DitherRowFunc = void(*)(const std::uint8_t* src, unsigned int srcBit,
+	std::uint8_t* dst, unsigned int dstBit, unsigned int count, unsigned int y);
+
+/// Returns the best available dithering row converter for the given format pair.
+/// Returns nullptr if the destination format has no color channel with
+/// less than 8 bits (or any of the formats is none), convertRowFunc should be used then.
+/// \sa ny::convertFormatDithered
+DitherRowFunc ditherRowFunc(ImageFormat from, ImageFormat to);
+
+/// Modifies count pixels of the given format in place.
+using PixelRowFunc = void(*)(std::uint8_t* data, unsigned int count);
+
+/// Returns the best available row kernel to (un)premultiply the given format.
+/// Returns nullptr for formats that don't have color and alpha channels.
+/// \sa ny::premultiply
+/// \sa ny::unpremultiply
+PixelRowFunc premultiplyRowFunc(ImageFormat format, bool resetAlpha);
+PixelRowFunc unpremultiplyRowFunc(ImageFormat format);
+
+/// Composites count premultiplied source pixels over the destination pixels
+/// (Porter-Duff over). The source pixels must have the format returned by
+/// compositeSourceFormat for the destination format and are always packed.
+/// Destination formats without alpha channel are treated as opaque.
+/// dstBit is the bit offset of the first destination pixel, see ConvertRowFunc.
+using CompositeRowFunc = void(*)(const std::uint8_t* src, std::uint8_t* dst,
+	unsigned int dstBit, unsigned int count);
+
+/// Returns the format the source pixels for the composite kernel of the
+/// given destination format must have. For 32-bit formats with 8-bit channels
+/// this is a format with the same color layout, otherwise argb8888.
+ImageFormat compositeSourceFormat(ImageFormat dst);
+
+/// Returns the best available over composite kernel for the given destination format.
+/// Returns nullptr for ImageFormat::none.
+/// \sa ny::composite
+CompositeRowFunc compositeOverRowFunc(ImageFormat dst);
+
+} // namespace ny::detail
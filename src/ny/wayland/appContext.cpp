@@ -13,6 +13,7 @@
 #include <ny/wayland/protocols/xdg-shell-v5.h>
 #include <ny/wayland/protocols/xdg-shell-v6.h>
 
+#include <ny/common/epoll.hpp>
 #include <dlg/dlg.hpp>
 
 #ifdef NY_WithEgl
@@ -81,13 +82,6 @@ void logHandler(const char* format, va_list vlist)
 	dlg_debug("wayland log: {}", lastLogMessage);
 }
 
-// Listener entry to implement custom fd polling callbacks in WaylandAppContext.
-struct ListenerEntry {
-	int fd {};
-	unsigned int events {};
-	std::function<bool(int fd, unsigned int events)> callback;
-};
-
 } // anonymous util namespace
 
 // NamesGlobal values are defined in impl because they need wayland/util.hpp
@@ -102,8 +96,8 @@ struct WaylandAppContext::Impl {
 	wayland::NamedGlobal<xdg_shell> xdgShellV5;
 	wayland::NamedGlobal<zxdg_shell_v6> xdgShellV6;
 
-	// here because ConnectionList is in wayland/util.hpp
-	ConnectionList<ListenerEntry> fdCallbacks;
+	EpollLoop fdCallbacks;
+	TimerQueue timers {fdCallbacks};
 
 	#ifdef NY_WithEgl
 		EglSetup eglSetup;
@@ -260,6 +254,7 @@ bool WaylandAppContext::pollEvents()
 		wl_display_dispatch_pending(wlDisplay_);
 	}
 
+	dispatchPosted();
 	deferred.execute();
 	return checkError();
 }
@@ -272,10 +267,30 @@ bool WaylandAppContext::waitEvents()
 
 	deferred.execute();
 	dispatchDisplay();
+	dispatchPosted();
+	deferred.execute();
+	return checkError();
+}
+
+bool WaylandAppContext::waitEvents(std::chrono::steady_clock::time_point deadline)
+{
+	if(!checkError()) {
+		return false;
+	}
+
+	deferred.execute();
+	dispatchDisplay(timeout(deadline));
+	dispatchPosted();
 	deferred.execute();
 	return checkError();
 }
 
+nytl::Connection WaylandAppContext::addTimer(std::chrono::steady_clock::duration duration,
+	bool repeat, std::function<void()> callback)
+{
+	return impl_->timers.add(duration, repeat, callback);
+}
+
 void WaylandAppContext::wakeupWait()
 {
 	std::int64_t v = 1;
@@ -462,7 +477,7 @@ bool WaylandAppContext::checkError() const
 nytl::Connection WaylandAppContext::fdCallback(int fd, unsigned int events,
 	const FdCallbackFunc& func)
 {
-	return impl_->fdCallbacks.add({fd, events, func});
+	return impl_->fdCallbacks.add(fd, events, func);
 }
 
 void WaylandAppContext::destroyDataSource(const WaylandDataSource& src)
@@ -472,7 +487,7 @@ void WaylandAppContext::destroyDataSource(const WaylandDataSource& src)
 	else dlg_warn("invalid data source object to destroy");
 }
 
-bool WaylandAppContext::dispatchDisplay()
+bool WaylandAppContext::dispatchDisplay(int timeout)
 {
 	wakeup_ = false;
 	int ret;
@@ -508,13 +523,14 @@ bool WaylandAppContext::dispatchDisplay()
 	}
 
 	// poll for server events (and since this might block for fd callbacks)
-	if(pollFds(POLLIN, -1) == -1) {
+	auto pollRet = pollFds(POLLIN, timeout);
+	if(pollRet == -1) {
 		wl_display_cancel_read(wlDisplay_);
 		return false;
 	}
 
-	// if dpypoll stopped due to the eventfd, cancel the wayland read
-	if(wakeup_) {
+	// if dpypoll stopped due to the eventfd or timed out, cancel the wayland read
+	if(wakeup_ || pollRet == 0) {
 		wl_display_cancel_read(wlDisplay_);
 		return true;
 	}
@@ -529,54 +545,26 @@ bool WaylandAppContext::dispatchDisplay()
 
 int WaylandAppContext::pollFds(short wlDisplayEvents, int timeout)
 {
-	// This function simply polls for all fd callbacks (and the wayland display fd if
-	// wlDisplayEvents != 0) with the given timeout and triggers the activated fd callbacks.
-	//
-	// This has to be done this complex since the callback functions may actually disconnect
-	// itself or other connections, i.e. impl_->fdCallbacks may change.
-	// We cannot use the fd as id, since there might be multiple callbacks on the same fd.
-	// ids holds the connectionID of the associated callback in fds (i.e. the pollfd with the
-	// same index)
-
-	std::vector<nytl::ConnectionID> ids;
-	std::vector<pollfd> fds;
-	ids.reserve(impl_->fdCallbacks.items.size());
-	fds.reserve(impl_->fdCallbacks.items.size() + 1);
-
-	for(auto& fdc : impl_->fdCallbacks.items) {
-		fds.push_back({fdc.fd, static_cast<short>(fdc.events), 0u});
-		ids.push_back({fdc.clID_});
+	// without display events only the fd callbacks are relevant
+	auto& loop = impl_->fdCallbacks;
+	if(!wlDisplayEvents) {
+		return loop.dispatch(timeout);
 	}
 
-	// add the wayland display fd to the pollfds
-	if(wlDisplayEvents) {
-		fds.push_back({wl_display_get_fd(&wlDisplay()), wlDisplayEvents, 0u});
-	}
+	// the epoll fd is readable if any of the fd callbacks are ready
+	pollfd fds[2] = {
+		{loop.fd(), POLLIN, 0},
+		{wl_display_get_fd(&wlDisplay()), wlDisplayEvents, 0},
+	};
 
-	auto ret = noSigPoll(*fds.data(), fds.size(), timeout);
+	auto ret = noSigPoll(*fds, 2, timeout);
 	if(ret < 0) {
 		dlg_info("poll failed: {}", std::strerror(errno));
 		return ret;
 	}
 
-	// check which fd callbacks have revents, find and trigger them
-	// fds.size() > ids.size() always true
-	for(auto i = 0u; i < ids.size(); ++i) {
-		if(!fds[i].revents) {
-			continue;
-		}
-
-		auto& items = impl_->fdCallbacks.items;
-		auto it = std::find_if(items.begin(), items.end(),
-			[&](auto& cb){ return cb.clID_.get() == ids[i].get(); });
-		if(it == items.end()) {
-			dlg_warn("invalid fd callback");
-			continue;
-		}
-
-		if(!it->callback(fds[i].fd, fds[i].revents)) {
-			items.erase(it);
-		}
+	if(fds[0].revents && loop.dispatch(0) < 0) {
+		return -1;
 	}
 
 	return ret;
@@ -613,7 +601,7 @@ void WaylandAppContext::handleRegistryAdd(wl_registry*, uint32_t id, const char*
 	// the supported interface versions by ny (for stable protocols)
 	// we always select the minimum between version supported by ny and version
 	// supported by the compositor
-	static constexpr auto compositorVersion = 1u;
+	static constexpr auto compositorVersion = 4u; // wl_surface.damage_buffer
 	static constexpr auto shellVersion = 1u;
 	static constexpr auto shmVersion = 1u;
 	static constexpr auto subcompositorVersion = 1u;
@@ -4,15 +4,38 @@
 
 #include <ny/wayland/bufferSurface.hpp>
 #include <ny/wayland/util.hpp>
+#include <ny/wayland/appContext.hpp>
 #include <ny/surface.hpp>
 #include <dlg/dlg.hpp>
 
+#include <wayland-client-core.h>
+
+#include <sys/resource.h> // getrusage
+
 #include <stdexcept> // std::runtime_error
 
 namespace ny {
+namespace {
+
+// Returns the number of page faults the calling thread caused so far
+std::uint64_t threadPageFaults()
+{
+	struct rusage usage {};
+	if(getrusage(RUSAGE_THREAD, &usage) < 0) {
+		return 0u;
+	}
+
+	return usage.ru_minflt + usage.ru_majflt;
+}
+
+} // anonymous util namespace
 
 // WaylandBufferSurface
-WaylandBufferSurface::WaylandBufferSurface(WaylandWindowContext& wc) : windowContext_(&wc)
+WaylandBufferSurface::WaylandBufferSurface(WaylandWindowContext& wc, unsigned int maxBuffers)
+	: windowContext_(&wc),
+		queue_(wl_display_create_queue(&wc.appContext().wlDisplay())),
+		pool_(wc.appContext(), queue_.get()),
+		maxBuffers_(maxBuffers ? maxBuffers : defaultMaxBuffers)
 {
 }
 
@@ -29,44 +52,133 @@ BufferGuard WaylandBufferSurface::buffer()
 		throw std::logic_error("ny::WlBufferSurface: there is already an active BufferGuard");
 	}
 
+	auto& b = *acquire(true);
+	auto age = prepare(b);
+	return {*this, image(b), age};
+}
+
+std::optional<BufferGuard> WaylandBufferSurface::tryBuffer()
+{
+	if(active_) {
+		throw std::logic_error("ny::WlBufferSurface: there is already an active BufferGuard");
+	}
+
+	auto b = acquire(false);
+	if(!b) {
+		return std::nullopt;
+	}
+
+	// construct in place, a moved-from BufferGuard would still apply
+	auto age = prepare(*b);
+	return std::optional<BufferGuard>(std::in_place, *this, image(*b), age);
+}
+
+WaylandBufferSurface::Buffer* WaylandBufferSurface::acquire(bool block)
+{
+	// process the release events received so far
+	auto& display = windowContext().appContext().wlDisplay();
+	if(wl_display_dispatch_queue_pending(&display, queue_.get()) < 0) {
+		throw std::runtime_error("ny::WlBufferSurface: wl_display_dispatch_queue_pending failed");
+	}
+
+	while(true) {
+		// prefer the unused buffer that was presented most recently, it needs
+		// the least redrawing (see BufferGuard::age)
+		Buffer* best {};
+		for(auto& b : buffers_) {
+			if(!b.buffer.used() && (!best || b.presented > best->presented)) {
+				best = &b;
+			}
+		}
+
+		if(best) {
+			return best;
+		}
+
+		if(buffers_.size() < maxBuffers_) {
+			return &buffers_.emplace_back();
+		}
+
+		if(!block) {
+			return nullptr;
+		}
+
+		// wait for the compositor to release a buffer. Only our queue
+		// is dispatched, events for other queues are just read
+		if(wl_display_dispatch_queue(&display, queue_.get()) < 0) {
+			throw std::runtime_error("ny::WlBufferSurface: wl_display_dispatch_queue failed");
+		}
+	}
+}
+
+unsigned int WaylandBufferSurface::prepare(Buffer& b)
+{
 	auto size = windowContext().size();
-	for(auto& b : buffers_) {
-		if(b.used()) continue;
-		if(b.size() != size) b.size(size);
-
-		b.use();
-		active_ = &b;
-		auto format = waylandToImageFormat(b.format());
-		return {*this, {&b.data(), size, format, b.stride() * 8}};
+	auto age = 0u;
+	if(b.buffer.size() != size) {
+		auto start = std::chrono::steady_clock::now();
+
+		// newly created buffers have no pool (and therefore no size) yet
+		if(b.buffer.size() == nytl::Vec2ui{}) {
+			b.buffer = {pool_, size};
+		} else {
+			b.buffer.size(size);
+		}
+
+		++stats_.allocations;
+		stats_.allocationTime += std::chrono::steady_clock::now() - start;
+		b.presented = 0u;
+	} else if(b.presented) {
+		age = presentCount_ - b.presented + 1;
 	}
 
-	// create new buffer if none is unused
-	buffers_.emplace_back(windowContext().appContext(), size);
-	buffers_.back().use();
-	active_ = &buffers_.back();
-	auto format = waylandToImageFormat(buffers_.back().format());
-	if(format == ImageFormat::none)
+	b.buffer.use();
+	active_ = &b;
+	faults_ = threadPageFaults();
+	return age;
+}
+
+MutableImage WaylandBufferSurface::image(Buffer& b) const
+{
+	auto format = waylandToImageFormat(b.buffer.format());
+	if(format == ImageFormat::none) {
 		throw std::runtime_error("ny::WlBufferSurface: failed to parse shm buffer format");
+	}
 
-	return {*this, {&buffers_.back().data(), size, format, buffers_.back().stride() * 8}};
+	auto& buffer = b.buffer;
+	return {&buffer.data(), buffer.size(), format, buffer.stride() * 8};
 }
 
 void WaylandBufferSurface::apply(const BufferGuard& buffer) noexcept
 {
-	if(!active_ || buffer.get().data != &active_->data()) {
+	if(!active_ || buffer.get().data != &active_->buffer.data()) {
 		dlg_warn("invalid BufferGuard given");
 		return;
 	}
 
-	windowContext().attachCommit(&active_->wlBuffer());
+	auto damage = nytl::Span<const nytl::Rect2ui> {};
+	if(!buffer.fullDamage()) {
+		damage = buffer.damage();
+	}
+
+	windowContext().attachCommit(&active_->buffer.wlBuffer(), damage);
+	active_->presented = ++presentCount_;
 	active_ = nullptr;
+
+	++stats_.frames;
+	stats_.pageFaults += threadPageFaults() - faults_;
+}
+
+void WaylandBufferSurface::QueueDeleter::operator()(wl_event_queue* queue) const
+{
+	wl_event_queue_destroy(queue);
 }
 
 // WaylandBufferWindowContext
 WaylandBufferWindowContext::WaylandBufferWindowContext(WaylandAppContext& ac,
 	const WaylandWindowSettings& settings) :
 		WaylandWindowContext(ac, settings),
-		bufferSurface_(*this)
+		bufferSurface_(*this, settings.buffer.maxBuffers)
 {
 	if(settings.buffer.storeSurface) {
 		*settings.buffer.storeSurface = &bufferSurface_;
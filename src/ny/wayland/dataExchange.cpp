@@ -270,7 +270,8 @@ WaylandDataSource::WaylandDataSource(WaylandAppContext& ac, std::unique_ptr<Data
 		if(img.data) {
 			dragSurface_ = wl_compositor_create_surface(&appContext_.wlCompositor());
 			dragBuffer_ = {appContext_, img.size};
-			convertFormat(img, waylandToImageFormat(dragBuffer_.format()), dragBuffer_.data(), 8u);
+			auto format = waylandToImageFormat(dragBuffer_.format());
+			convertPremultiply(img, format, dragBuffer_.data(), 8u);
 		}
 	}
 }
@@ -6,6 +6,7 @@
 #include <ny/wayland/appContext.hpp>
 #include <ny/wayland/windowContext.hpp>
 #include <ny/cursor.hpp>
+#include <ny/common/unix.hpp>
 
 #include <dlg/dlg.hpp>
 #include <nytl/scope.hpp>
@@ -21,6 +22,7 @@
 #include <string.h>
 #include <iostream>
 #include <cstring>
+#include <algorithm> // std::find_if, std::lower_bound, std::max
 
 namespace ny {
 namespace wayland {
@@ -96,6 +98,20 @@ int osCreateAnonymousFile(off_t size)
 	return fd;
 }
 
+// Advises the kernel to back large mappings with transparent huge pages.
+// Only a hint, shmem thp might be disabled.
+void adviseHugePages(std::uint8_t* data, std::size_t size)
+{
+#ifdef MADV_HUGEPAGE
+	if(size >= ShmPool::hugePageThreshold && madvise(data, size, MADV_HUGEPAGE) < 0) {
+		dlg_debug("madvise(MADV_HUGEPAGE) failed: {}", std::strerror(errno));
+	}
+#else
+	(void) data;
+	(void) size;
+#endif
+}
+
 } // anonymous util namespace
 
 //shmBuffer
@@ -225,6 +241,192 @@ bool ShmBuffer::size(nytl::Vec2ui size, unsigned int stride)
 	}
 }
 
+// ShmPool
+ShmPool::~ShmPool()
+{
+	if(pool_) wl_shm_pool_destroy(pool_);
+	if(data_) munmap(data_, size_);
+	if(fd_ >= 0) close(fd_);
+}
+
+unsigned int ShmPool::allocate(unsigned int size)
+{
+	size = ((size + alignment - 1) / alignment) * alignment;
+	auto fits = [&](auto& range) { return range.size >= size; };
+	auto it = std::find_if(free_.begin(), free_.end(), fits);
+	if(it == free_.end()) {
+		// grow at least by a factor of 2 to keep the number of resizes low
+		grow(std::max(size_ + size, 2 * size_));
+		it = std::find_if(free_.begin(), free_.end(), fits);
+		dlg_assert(it != free_.end());
+	}
+
+	auto offset = it->offset;
+	it->offset += size;
+	it->size -= size;
+	if(!it->size) {
+		free_.erase(it);
+	}
+
+	return offset;
+}
+
+void ShmPool::free(unsigned int offset, unsigned int size)
+{
+	size = ((size + alignment - 1) / alignment) * alignment;
+	auto it = std::lower_bound(free_.begin(), free_.end(), offset,
+		[](auto& range, auto value) { return range.offset < value; });
+	it = free_.insert(it, {offset, size});
+
+	// merge with the adjacent free ranges
+	auto next = it + 1;
+	if(next != free_.end() && it->offset + it->size == next->offset) {
+		it->size += next->size;
+		free_.erase(next);
+	}
+
+	if(it != free_.begin()) {
+		auto prev = it - 1;
+		if(prev->offset + prev->size == it->offset) {
+			prev->size += it->size;
+			free_.erase(it);
+		}
+	}
+}
+
+void ShmPool::grow(unsigned int size)
+{
+	auto* shm = appContext_->wlShm();
+	if(!shm) throw std::runtime_error("ny::wayland::ShmPool: appContext has no wl_shm");
+
+	if(size >= hugePageThreshold) {
+		size = ((size + hugePageSize - 1) / hugePageSize) * hugePageSize;
+	}
+
+	if(!pool_) {
+		fd_ = createMemfd("ny-wayland-shm", size);
+		if(fd_ < 0) fd_ = osCreateAnonymousFile(size);
+		if(fd_ < 0) throw std::runtime_error("ny::wayland::ShmPool: could not create shm file");
+
+		// pre-fault the pages, the buffers will be completely written anyways
+		auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+		if(ptr == MAP_FAILED) throw std::runtime_error("ny::wayland::ShmPool: could not mmap file");
+
+		data_ = static_cast<std::uint8_t*>(ptr);
+		adviseHugePages(data_, size);
+		pool_ = wl_shm_create_pool(shm, fd_, size);
+
+		// proxies created from the pool (the buffers) inherit its queue
+		if(queue_) {
+			wl_proxy_set_queue(reinterpret_cast<wl_proxy*>(pool_), queue_);
+		}
+	} else {
+		if(ftruncate(fd_, size) < 0) {
+			throw std::runtime_error("ny::wayland::ShmPool: could not grow shm file");
+		}
+
+		auto ptr = mremap(data_, size_, size, MREMAP_MAYMOVE);
+		if(ptr == MAP_FAILED) throw std::runtime_error("ny::wayland::ShmPool: could not remap file");
+
+		data_ = static_cast<std::uint8_t*>(ptr);
+		adviseHugePages(data_, size);
+
+		// mremap does not populate the new pages
+#ifdef MADV_POPULATE_WRITE
+		madvise(data_ + size_, size - size_, MADV_POPULATE_WRITE);
+#endif
+
+		wl_shm_pool_resize(pool_, size);
+	}
+
+	// add the new space to the free ranges
+	auto old = size_;
+	size_ = size;
+	free(old, size - old);
+}
+
+// PoolBuffer
+PoolBuffer::PoolBuffer(ShmPool& pool, nytl::Vec2ui size, unsigned int stride)
+	: pool_(&pool), size_(size), stride_(stride)
+{
+	format_ = WL_SHM_FORMAT_ARGB8888;
+	if(!stride_) stride_ = size[0] * 4;
+	create();
+}
+
+PoolBuffer::~PoolBuffer()
+{
+	destroy();
+}
+
+PoolBuffer::PoolBuffer(PoolBuffer&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+PoolBuffer& PoolBuffer::operator=(PoolBuffer&& other) noexcept
+{
+	destroy();
+
+	pool_ = other.pool_;
+	size_ = other.size_;
+	stride_ = other.stride_;
+	offset_ = other.offset_;
+	rangeSize_ = other.rangeSize_;
+	buffer_ = other.buffer_;
+	format_ = other.format_;
+	used_ = other.used_;
+
+	other.pool_ = {};
+	other.rangeSize_ = {};
+	other.buffer_ = {};
+	other.used_ = {};
+
+	if(buffer_) wl_buffer_set_user_data(buffer_, this);
+	return *this;
+}
+
+void PoolBuffer::size(nytl::Vec2ui size, unsigned int stride)
+{
+	size_ = size;
+	stride_ = stride ? stride : size[0] * 4;
+	create();
+}
+
+void PoolBuffer::create()
+{
+	if(!size_[0] || !size_[1]) throw std::runtime_error("ny::wayland::PoolBuffer invalid size");
+	if(buffer_) wl_buffer_destroy(buffer_);
+	buffer_ = {};
+
+	// only allocate a new range if the old one is too small
+	auto byteSize = stride_ * size_[1];
+	if(byteSize > rangeSize_) {
+		if(rangeSize_) pool_->free(offset_, rangeSize_);
+		rangeSize_ = 0;
+		offset_ = pool_->allocate(byteSize);
+		rangeSize_ = byteSize;
+	}
+
+	buffer_ = wl_shm_pool_create_buffer(pool_->wlShmPool(), offset_, size_[0], size_[1],
+		stride_, format_);
+
+	static constexpr wl_buffer_listener listener {
+		memberCallback<&PoolBuffer::released>
+	};
+
+	wl_buffer_add_listener(buffer_, &listener, this);
+}
+
+void PoolBuffer::destroy()
+{
+	if(buffer_) wl_buffer_destroy(buffer_);
+	if(pool_ && rangeSize_) pool_->free(offset_, rangeSize_);
+
+	buffer_ = {};
+	rangeSize_ = {};
+}
+
 // Output
 Output::Output(WaylandAppContext& ac, wl_output& outp, unsigned int id)
 	: appContext_(&ac), wlOutput_(&outp), globalID_(id)
@@ -425,12 +627,15 @@ constexpr struct FormatConversion {
 	unsigned int shmFormat;
 } formatConversions[] {
 	{ImageFormat::argb8888, WL_SHM_FORMAT_ARGB8888},
-	{ImageFormat::argb8888, WL_SHM_FORMAT_XRGB8888},
+	{ImageFormat::xrgb8888, WL_SHM_FORMAT_XRGB8888},
+	{ImageFormat::xbgr8888, WL_SHM_FORMAT_XBGR8888},
 	{ImageFormat::rgba8888, WL_SHM_FORMAT_RGBA8888},
 	{ImageFormat::bgra8888, WL_SHM_FORMAT_BGRA8888},
 	{ImageFormat::abgr8888, WL_SHM_FORMAT_ABGR8888},
 	{ImageFormat::bgr888, WL_SHM_FORMAT_BGR888},
 	{ImageFormat::rgb888, WL_SHM_FORMAT_RGB888},
+	{ImageFormat::rgb565, WL_SHM_FORMAT_RGB565},
+	{ImageFormat::xrgb2101010, WL_SHM_FORMAT_XRGB2101010},
 };
 
 int imageFormatToWayland(const ImageFormat& format)
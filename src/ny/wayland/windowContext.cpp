@@ -254,7 +254,7 @@ void WaylandWindowContext::cursor(const Cursor& cursor)
 		}
 
 		shmCursorBuffer_ = wayland::ShmBuffer(appContext(), img.size);
-		convertFormat(img, waylandToImageFormat(shmCursorBuffer_.format()),
+		convertPremultiply(img, waylandToImageFormat(shmCursorBuffer_.format()),
 			shmCursorBuffer_.data(), 8u);
 
 		cursorHotspot_ = cursor.imageHotspot();
@@ -476,7 +476,8 @@ wl_display& WaylandWindowContext::wlDisplay() const
 	return appContext().wlDisplay();
 }
 
-void WaylandWindowContext::attachCommit(wl_buffer* buffer)
+void WaylandWindowContext::attachCommit(wl_buffer* buffer,
+		nytl::Span<const nytl::Rect2ui> damage)
 {
 	using WWC = WaylandWindowContext;
 	static constexpr wl_callback_listener frameListener {
@@ -485,7 +486,25 @@ void WaylandWindowContext::attachCommit(wl_buffer* buffer)
 
 	frameCallback_ = wl_surface_frame(wlSurface_);
 	wl_callback_add_listener(frameCallback_, &frameListener, this);
-	wl_surface_damage(wlSurface_, 0, 0, size_[0], size_[1]);
+
+	if(damage.empty()) {
+		wl_surface_damage(wlSurface_, 0, 0, size_[0], size_[1]);
+	} else {
+		// damage_buffer avoids the conversion to surface coordinates on the
+		// compositor side. Since ny never sets a buffer scale or transform, both
+		// are equal for older compositors
+		auto bufferDamage = wl_surface_get_version(wlSurface_) >=
+			WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+		for(auto& r : damage) {
+			if(bufferDamage) {
+				wl_surface_damage_buffer(wlSurface_, r.position[0], r.position[1],
+					r.size[0], r.size[1]);
+			} else {
+				wl_surface_damage(wlSurface_, r.position[0], r.position[1], r.size[0], r.size[1]);
+			}
+		}
+	}
+
 	wl_surface_attach(wlSurface_, buffer, 0, 0);
 
 	wl_surface_commit(wlSurface_);
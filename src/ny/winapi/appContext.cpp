@@ -145,6 +145,7 @@ bool WinapiAppContext::pollEvents()
 {
 	deferred.execute();
 	while(dispatchEvent());
+	dispatchPosted();
 	deferred.execute();
 	return true;
 }
@@ -169,6 +170,7 @@ bool WinapiAppContext::waitEvents()
 
 	// dispatch all events that are still pending
 	while(dispatchEvent());
+	dispatchPosted();
 	deferred.execute();
 	return true;
 }
@@ -318,8 +318,7 @@ std::system_error lastErrorException(std::string_view msg) {
 }
 
 HBITMAP toBitmap(const Image& img) {
-	auto copy = convertFormat(img, ImageFormat::argb8888);
-	premultiply(copy);
+	auto copy = convertPremultiply(img, ImageFormat::argb8888);
 
 	BITMAPV5HEADER header {};
 	header.bV5Size = sizeof(header);
@@ -357,7 +356,7 @@ UniqueImage toImage(HBITMAP hbitmap) {
 	unsigned int height = std::abs(bminfo.bmiHeader.biHeight);
 	unsigned int stride = width * 4;
 
-	auto buffer = std::make_unique<uint8_t[]>(height * width * 4);
+	auto buffer = allocateImageData(height * width * 4);
 
 	bminfo.bmiHeader.biBitCount = 32;
 	bminfo.bmiHeader.biCompression = BI_RGB;
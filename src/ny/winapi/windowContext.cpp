@@ -441,9 +441,7 @@ void WinapiWindowContext::icon(const Image& img)
 	}
 
 	constexpr static auto reqFormat = ImageFormat::argb8888;
-	auto uniqueImage = convertFormat(img, reqFormat);
-
-	premultiply(uniqueImage);
+	auto uniqueImage = convertPremultiply(img, reqFormat);
 
 	auto pixelsData = data(uniqueImage);
 	icon_ = ::CreateIcon(hinstance(), img.size[0], img.size[1], 1, 32, nullptr, pixelsData);
@@ -0,0 +1,101 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <ny/workerPool.hpp>
+
+namespace ny::detail {
+
+WorkerPool& WorkerPool::instance()
+{
+	static WorkerPool pool([]{
+		auto hw = std::thread::hardware_concurrency();
+		return hw > 1 ? hw - 1 : 0u;
+	}());
+
+	return pool;
+}
+
+WorkerPool::WorkerPool(unsigned int workers)
+{
+	threads_.reserve(workers);
+	for(auto i = 0u; i < workers; ++i) {
+		threads_.emplace_back([this]{ workerMain(); });
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard lock(mutex_);
+		exit_ = true;
+	}
+
+	jobCV_.notify_all();
+	for(auto& thread : threads_) {
+		thread.join();
+	}
+}
+
+void WorkerPool::Job::work()
+{
+	for(auto i = next++; i < count; i = next++) {
+		func(i);
+	}
+}
+
+void WorkerPool::run(unsigned int count, const std::function<void(unsigned int)>& func)
+{
+	if(threads_.empty() || count <= 1) {
+		for(auto i = 0u; i < count; ++i) {
+			func(i);
+		}
+
+		return;
+	}
+
+	std::lock_guard runLock(runMutex_);
+	Job job {func, count};
+
+	{
+		std::lock_guard lock(mutex_);
+		job_ = &job;
+		++generation_;
+	}
+
+	jobCV_.notify_all();
+	job.work();
+
+	// when the calling thread runs out of work, all remaining calls are
+	// in progress on workers. Wait for them to finish before returning since
+	// they reference the job.
+	std::unique_lock lock(mutex_);
+	job_ = nullptr;
+	doneCV_.wait(lock, [&]{ return active_ == 0; });
+}
+
+void WorkerPool::workerMain()
+{
+	auto seen = 0u;
+	std::unique_lock lock(mutex_);
+	while(true) {
+		jobCV_.wait(lock, [&]{ return exit_ || (job_ && generation_ != seen); });
+		if(exit_) {
+			return;
+		}
+
+		seen = generation_;
+		auto job = job_;
+		++active_;
+
+		lock.unlock();
+		job->work();
+		lock.lock();
+
+		if(--active_ == 0) {
+			doneCV_.notify_all();
+		}
+	}
+}
+
+} // namespace ny::detail
@@ -0,0 +1,66 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <atomic> // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <functional> // std::function
+#include <mutex> // std::mutex
+#include <thread> // std::thread
+#include <vector> // std::vector
+
+namespace ny::detail {
+
+/// Small internal pool of worker threads used to split up long running
+/// operations (like image conversions) into independent parts.
+/// The calling thread always participates in the work, so a pool without
+/// any workers just executes everything on the calling thread.
+class WorkerPool {
+public:
+	/// Returns the global pool, which is created on first use and has one worker
+	/// less than the number of hardware threads.
+	static WorkerPool& instance();
+
+public:
+	WorkerPool(unsigned int workers);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	/// The maximum number of threads that can work on one job, including
+	/// the calling thread.
+	unsigned int concurrency() const { return threads_.size() + 1; }
+
+	/// Calls func(i) for every i in [0, count) and returns when all calls
+	/// have finished. The calls may happen concurrently on up to concurrency()
+	/// threads and in any order.
+	/// Concurrent calls of this function are serialized.
+	void run(unsigned int count, const std::function<void(unsigned int)>& func);
+
+private:
+	struct Job {
+		const std::function<void(unsigned int)>& func;
+		unsigned int count;
+		std::atomic<unsigned int> next {0u};
+
+		void work();
+	};
+
+	void workerMain();
+
+private:
+	std::vector<std::thread> threads_;
+	std::mutex runMutex_; // serializes run
+	std::mutex mutex_; // guards the members below
+	std::condition_variable jobCV_;
+	std::condition_variable doneCV_;
+	Job* job_ {};
+	unsigned int active_ {}; // number of workers using job_
+	unsigned int generation_ {};
+	bool exit_ {};
+};
+
+} // namespace ny::detail
@@ -10,6 +10,7 @@
 #include <ny/x11/dataExchange.hpp>
 
 #include <ny/common/unix.hpp>
+#include <ny/common/epoll.hpp>
 #include <ny/dataExchange.hpp>
 
 #ifdef NY_WithVulkan
@@ -38,11 +39,20 @@
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 #include <xcb/xcb_ewmh.h>
+#include <xcb/shm.h>
+#include <xcb/present.h>
 
+#include <poll.h> // POLLIN
+#include <sys/eventfd.h> // eventfd
+#include <unistd.h> // read, write, close
+
+#include <algorithm> // std::find_if
 #include <cstring>
+#include <cstdlib> // std::getenv
 #include <mutex>
 #include <atomic>
 #include <queue>
+#include <deque>
 
 namespace ny {
 
@@ -51,6 +61,14 @@ struct X11AppContext::Impl {
 	x11::Atoms atoms;
 	X11ErrorCategory errorCategory;
 	X11DataManager dataManager;
+	std::deque<x11::GenericEvent*> pending; // events queued by waitFor
+	EpollLoop loop; // for the x connection and fd callbacks
+	TimerQueue timers {loop};
+
+	// wakeupWait only writes the eventfd if waitEvents is blocking (or about to)
+	int eventfd {-1};
+	std::atomic<bool> waiting {};
+	std::atomic<bool> wakeup {};
 
 #ifdef NY_WithGl
 	GlxSetup glxSetup;
@@ -59,12 +77,11 @@ struct X11AppContext::Impl {
 };
 
 // AppContext
-X11AppContext::X11AppContext()
+X11AppContext::X11AppContext(const X11AppContextSettings& settings)
 {
-	// TODO, make this optional, may be needed by some applications
-	// Something like a threadsafe flags in X11AppContextSettings would make sense
-	// we use it only in wakeupWait (if called from other thread)
-	XInitThreads();
+	if(settings.initThreads) {
+		XInitThreads();
+	}
 
 	impl_ = std::make_unique<Impl>();
 
@@ -80,7 +97,25 @@ X11AppContext::X11AppContext()
 		throw std::runtime_error("ny::X11AppContext: unable to get xcb connection");
 	}
 
+	// waitEvents waits for the x connection with the fd callbacks.
+	// The events are read by xcb itself, the callback only wakes up.
+	auto xfd = xcb_get_file_descriptor(xConnection_);
+	impl_->loop.add(xfd, POLLIN, [](int, unsigned int) { return true; });
+
+	// create eventfd needed for wakeupWait
+	impl_->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(impl_->eventfd < 0) {
+		throw std::runtime_error("ny::X11AppContext: could not create eventfd");
+	}
+
+	impl_->loop.add(impl_->eventfd, POLLIN, [](int fd, unsigned int) {
+		std::uint64_t v;
+		::read(fd, &v, 8);
+		return true;
+	});
+
 	impl_->errorCategory = {*xDisplay_, *xConnection_};
+	impl_->errorCategory.synchronous(std::getenv("NY_X11_SYNCHRONOUS"));
 	auto ewmhCookie = xcb_ewmh_init_atoms(&xConnection(), &ewmhConnection());
 
 	// query server information
@@ -218,6 +253,23 @@ X11AppContext::X11AppContext()
 		dlg_debug("XInput not avilable");
 	}
 
+	// check for shm (needed for the completion events of X11BufferSurface)
+	auto shmExt = xcb_get_extension_data(xConnection_, &xcb_shm_id);
+	if(shmExt && shmExt->present) {
+		shmCompletionEvent_ = shmExt->first_event + XCB_SHM_COMPLETION;
+	}
+
+	// check for present (used by X11BufferSurface)
+	auto presentExt = xcb_get_extension_data(xConnection_, &xcb_present_id);
+	if(presentExt && presentExt->present) {
+		auto cookie = xcb_present_query_version(xConnection_, 1, 0);
+		auto reply = xcb_present_query_version_reply(xConnection_, cookie, nullptr);
+		if(reply) {
+			presentOpcode_ = presentExt->major_opcode;
+			free(reply);
+		}
+	}
+
 	// input
 	keyboardContext_ = std::make_unique<X11KeyboardContext>(*this);
 	mouseContext_ = std::make_unique<X11MouseContext>(*this);
@@ -231,11 +283,20 @@ X11AppContext::~X11AppContext()
 	if(next_) {
 		free(next_);
 	}
+	if(impl_) {
+		for(auto event : impl_->pending) {
+			free(event);
+		}
+	}
 	if(xDisplay_) {
 		::XFlush(&xDisplay());
 	}
 
 	xcb_ewmh_connection_wipe(&ewmhConnection());
+	if(impl_ && impl_->eventfd >= 0) {
+		close(impl_->eventfd);
+	}
+
 	impl_.reset();
 
 	if(xDummyWindow_) {
@@ -298,27 +359,48 @@ bool X11AppContext::pollEvents()
 	}
 
 	deferred.execute();
+	if(impl_->loop.dispatch(0) < 0) {
+		dlg_warn("pollEvents: dispatching fd callbacks failed");
+	}
+
 	while(true) {
 		xcb_flush(&xConnection());
 		xcb_generic_event_t* event {};
 		if(next_) {
 			event = next_;
 			next_ = nullptr;
-		} else if(!(event = xcb_poll_for_event(xConnection_))) {
+		} else if(!(event = pollEvent())) {
 			break;
 		}
 
-		next_ = static_cast<x11::GenericEvent*>(xcb_poll_for_event(xConnection_));
+		next_ = pollEvent();
 		processEvent(static_cast<x11::GenericEvent&>(*event), next_);
 		free(event);
 	}
 
+	dispatchPosted();
 	xcb_flush(&xConnection());
 	deferred.execute();
 	return checkError();
 }
 
 bool X11AppContext::waitEvents()
+{
+	return dispatchWait(-1);
+}
+
+bool X11AppContext::waitEvents(std::chrono::steady_clock::time_point deadline)
+{
+	return dispatchWait(timeout(deadline));
+}
+
+nytl::Connection X11AppContext::addTimer(std::chrono::steady_clock::duration duration,
+	bool repeat, std::function<void()> callback)
+{
+	return impl_->timers.add(duration, repeat, callback);
+}
+
+bool X11AppContext::dispatchWait(int timeout)
 {
 	if(!checkError()) {
 		return false;
@@ -327,34 +409,104 @@ bool X11AppContext::waitEvents()
 	deferred.execute();
 	xcb_flush(&xConnection());
 
-	xcb_generic_event_t* event;
-	if(!(event = xcb_wait_for_event(xConnection_))) {
-		dlg_warn("waitEvents: xcb_wait_for_event: I/O error");
-		return checkError();
+	// Dispatch the ready fd callbacks and timers, only block if there are no x events.
+	// Returns without dispatching x events if only fd callbacks were triggered.
+	// Don't block if wakeupWait was called since the last wait.
+	// Setting waiting before checking makes sure wakeupWait either sets
+	// wakeup before we check it or sees waiting and signals the eventfd
+	xcb_generic_event_t* event = pollEvent();
+	impl_->waiting.store(true);
+	auto block = !event && !impl_->wakeup.exchange(false);
+	if(impl_->loop.dispatch(block ? timeout : 0) < 0) {
+		dlg_warn("waitEvents: dispatching fd callbacks failed");
+	}
+
+	impl_->waiting.store(false);
+	impl_->wakeup.store(false);
+
+	if(!event) {
+		event = pollEvent();
 	}
 
 	while(event) {
 		xcb_flush(&xConnection());
-		next_ = static_cast<x11::GenericEvent*>(xcb_poll_for_event(xConnection_));
+		next_ = pollEvent();
 		processEvent(static_cast<x11::GenericEvent&>(*event), next_);
 		free(event);
 		event = next_;
 	}
 
+	dispatchPosted();
 	xcb_flush(&xConnection());
 	deferred.execute();
 	return checkError();
 }
 
-void X11AppContext::wakeupWait()
+x11::GenericEvent* X11AppContext::pollEvent()
+{
+	if(!impl_->pending.empty()) {
+		auto event = impl_->pending.front();
+		impl_->pending.pop_front();
+		return event;
+	}
+
+	return static_cast<x11::GenericEvent*>(xcb_poll_for_event(xConnection_));
+}
+
+bool X11AppContext::waitFor(const std::function<bool(const x11::GenericEvent&)>& pred)
 {
-	// TODO: only send if currently blocking?
-	// TODO: just use eventfd and custom poll instead?
-	xcb_client_message_event_t dummyEvent {};
-	dummyEvent.type = XCB_CLIENT_MESSAGE;
-	auto eventData = reinterpret_cast<const char*>(&dummyEvent);
-	xcb_send_event(xConnection_, 0, xDummyWindow(), 0, eventData);
+	// the event might already have been read
+	if(next_ && pred(*next_)) {
+		auto event = next_;
+		next_ = nullptr;
+		processEvent(*event, nullptr);
+		free(event);
+		return true;
+	}
+
+	auto& pending = impl_->pending;
+	auto it = std::find_if(pending.begin(), pending.end(), [&](auto* ev) { return pred(*ev); });
+	if(it != pending.end()) {
+		auto event = *it;
+		pending.erase(it);
+		processEvent(*event, nullptr);
+		free(event);
+		return true;
+	}
+
 	xcb_flush(xConnection_);
+	while(true) {
+		auto event = static_cast<x11::GenericEvent*>(xcb_wait_for_event(xConnection_));
+		if(!event) {
+			dlg_warn("waitFor: xcb_wait_for_event: I/O error");
+			return false;
+		}
+
+		if(pred(*event)) {
+			processEvent(*event, nullptr);
+			free(event);
+			return true;
+		}
+
+		impl_->pending.push_back(event);
+	}
+}
+
+nytl::Connection X11AppContext::fdCallback(int fd, unsigned int events,
+	const FdCallbackFunc& func)
+{
+	return impl_->loop.add(fd, events, func);
+}
+
+void X11AppContext::wakeupWait()
+{
+	// only signal the eventfd if waitEvents is actually blocking, this
+	// way frequent wakeups (e.g. from worker threads) are cheap
+	impl_->wakeup.store(true);
+	if(impl_->waiting.load()) {
+		std::uint64_t v = 1;
+		::write(impl_->eventfd, &v, 8);
+	}
 }
 
 bool X11AppContext::clipboard(std::unique_ptr<DataSource>&& dataSource)
@@ -499,6 +651,8 @@ void X11AppContext::processEvent(const x11::GenericEvent& ev, const x11::Generic
 
 	// TODO: make windowContext handle events to remove friend decl
 
+	errorCategory().processed(ev.full_sequence);
+
 	auto responseType = ev.response_type & ~0x80;
 	switch(responseType) {
 		case XCB_EXPOSE: {
@@ -586,22 +740,42 @@ void X11AppContext::processEvent(const x11::GenericEvent& ev, const x11::Generic
 		}
 
 	case 0u: {
-			int code = reinterpret_cast<const xcb_generic_error_t&>(ev).error_code;
-			auto errorMsg = x11::errorMessage(xDisplay(), code);
-			dlg_warn("retrieved error code {}, {}", code, errorMsg);
-
+			errorCategory().handleError(reinterpret_cast<const xcb_generic_error_t&>(ev));
 			break;
 		}
 
 		default: break;
 	}
 
+	if(shmCompletionEvent_ && responseType == shmCompletionEvent_) {
+		auto& completion = reinterpret_cast<const xcb_shm_completion_event_t&>(ev);
+		auto wc = windowContext(completion.drawable);
+		if(wc) {
+			wc->shmCompletionEvent(completion.shmseg, ev.full_sequence);
+		}
+
+		return;
+	}
+
+	auto& gev = reinterpret_cast<const xcb_ge_generic_event_t&>(ev);
+	if(presentOpcode_ && gev.response_type == XCB_GE_GENERIC &&
+			gev.extension == presentOpcode_) {
+
+		// all present events we select have the window at the same offset
+		auto& pev = reinterpret_cast<const xcb_present_complete_notify_event_t&>(ev);
+		auto wc = windowContext(pev.window);
+		if(wc) {
+			wc->presentEvent(ev);
+		}
+
+		return;
+	}
+
 	if(impl_->dataManager.processEvent(ev)) return;
 	if(keyboardContext_->processEvent(ev, next)) return;
 	if(mouseContext_->processEvent(ev)) return;
 
 	// touch events
-	auto& gev = reinterpret_cast<const xcb_ge_generic_event_t&>(ev);
 	if(xiOpcode_ && gev.response_type == XCB_GE_GENERIC &&
 			gev.extension == xiOpcode_) {
 
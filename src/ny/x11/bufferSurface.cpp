@@ -5,16 +5,24 @@
 #include <ny/x11/bufferSurface.hpp>
 #include <ny/x11/appContext.hpp>
 #include <ny/x11/util.hpp>
+#include <ny/common/unix.hpp>
 #include <nytl/vecOps.hpp>
 #include <dlg/dlg.hpp>
 
 #include <xcb/xcb_image.h>
 #include <xcb/shm.h>
+#include <xcb/present.h>
 
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#include <cstring>
+#include <algorithm> // std::sort, std::min, std::max, std::all_of
+#include <cerrno> // errno
+#include <cstring> // std::strerror, std::memcpy
+#include <vector> // std::vector
 
 // sources:
 // https://github.com/freedesktop-unofficial-mirror/xcb__util-image/blob/master/image/xcb_image.c#L158
@@ -29,20 +37,28 @@
 // we want to avoid additional overhead at resizing and since using it would make
 // the implementation (shm switch) even more complex.
 
-// When not using the shm version, we should have to check not to exceed the maximum
-// request length, but since this is usually pretty low (even with big requests extensions
-// somewhere around 4MB on test machine) band putting the image onto the window works
-// nontheless (somehow?!) and xcb-util-image does not check/split as well, so we don't check for
-// request length exceeding.
+// When not using the shm version, the image is uploaded in chunks that don't exceed
+// the maximum request length (see X11BufferSurface::putImage). xcb-util-image does
+// not check/split this but exceeding it closes the connection, which happens for
+// large windows on remote displays (where shm is usually not available).
 
 namespace ny {
 
-X11BufferSurface::X11BufferSurface(X11WindowContext& wc) : windowContext_(&wc)
+X11BufferSurface::X11BufferSurface(X11WindowContext& wc, unsigned int maxSegments,
+	bool present)
+	: windowContext_(&wc), maxSegments_(maxSegments ? maxSegments : defaultMaxSegments)
 {
 	gc_ = xcb_generate_id(&xConnection());
 	std::uint32_t value[] = {0, 0};
-	auto c = xcb_create_gc_checked(&xConnection(), gc_, wc.xWindow(), XCB_GC_FOREGROUND, value);
-	windowContext().errorCategory().checkThrow(c, "ny::X11BufferSurface: create_gc");
+	auto& errorCategory = wc.appContext().errorCategory();
+	if(errorCategory.synchronous()) {
+		auto c = xcb_create_gc_checked(&xConnection(), gc_, wc.xWindow(),
+			XCB_GC_FOREGROUND, value);
+		errorCategory.checkThrow(c, "ny::X11BufferSurface: create_gc");
+	} else {
+		auto c = xcb_create_gc(&xConnection(), gc_, wc.xWindow(), XCB_GC_FOREGROUND, value);
+		errorCategory.watch(c, "ny::X11BufferSurface: create_gc");
+	}
 
 	// query the format
 	// this is needed because the xserver may need a different bpp for an image
@@ -65,7 +81,10 @@ X11BufferSurface::X11BufferSurface(X11WindowContext& wc) : windowContext_(&wc)
 		throw std::runtime_error("ny::X11BufferSurface: couldn't query depth format bpp");
 	}
 
-	format_ = x11::visualToFormat(*windowContext().xVisualType(), fmt->bits_per_pixel);
+	// rows of images (shm or not) are expected to be padded to scanline_pad bits
+	scanlinePad_ = fmt->scanline_pad;
+	format_ = x11::visualToFormat(*windowContext().xVisualType(), fmt->depth,
+		fmt->bits_per_pixel);
 	if(format_ == ImageFormat::none) {
 		throw std::runtime_error("ny::X11BufferSurface: couldn't parse visual format");
 	}
@@ -75,9 +94,25 @@ X11BufferSurface::X11BufferSurface(X11WindowContext& wc) : windowContext_(&wc)
 	auto cookie = xcb_shm_query_version(&xConnection());
 	auto reply = xcb_shm_query_version_reply(&xConnection(), cookie, nullptr);
 
+	// fd passing (and therefore memfd segments) is supported since version 1.2
 	shm_ = (reply);
-	if(reply) free(reply);
+	if(reply) {
+		shmFd_ = reply->major_version > 1 ||
+			(reply->major_version == 1 && reply->minor_version >= 2);
+		free(reply);
+	}
+
 	if(!shm_) dlg_warn("shm server does not support shm extension");
+
+	// use present if requested and available, see the class documentation
+	present_ = present && shm_ && wc.appContext().presentOpcode();
+	if(present && !present_) dlg_warn("present not supported, putting images instead");
+	if(present_) {
+		presentEventID_ = xcb_generate_id(&xConnection());
+		auto mask = XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY | XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY;
+		auto c = xcb_present_select_input(&xConnection(), presentEventID_, wc.xWindow(), mask);
+		errorCategory.watch(c, "ny::X11BufferSurface: present_select_input");
+	}
 }
 
 X11BufferSurface::~X11BufferSurface()
@@ -85,10 +120,8 @@ X11BufferSurface::~X11BufferSurface()
 	if(active_) dlg_warn("there is still an active BufferGuard");
 	if(gc_) xcb_free_gc(&xConnection(), gc_);
 
-	if(shmseg_) {
-		xcb_shm_detach(&xConnection(), shmseg_);
-		shmdt(data_);
-		shmctl(shmid_, IPC_RMID, 0);
+	for(auto& segment : segments_) {
+		destroy(segment);
 	}
 }
 
@@ -102,40 +135,255 @@ BufferGuard X11BufferSurface::buffer()
 	// TODO: querySize() might be needed here. But this would produce
 	//  unexpected results (return image size) for the caller.
 	auto size = windowContext().size();
-	auto newBytes = std::ceil(size[0] * size[1] * bitSize(format_) / 8.0); //the needed size
-	if(newBytes > byteSize_) {
-		// we alloc more than is really needed because this will
-		// speed up (especially the shm version) resizes. We don't have to reallocated
-		// every time the window is resized and redrawn for the cost of higher memory
-		// consumption
-		byteSize_ = newBytes * 4;
-
-		if(shm_) {
-			if(shmseg_) {
-				xcb_shm_detach(&xConnection(), shmseg_);
-				shmdt(data_);
-				shmctl(shmid_, IPC_RMID, 0);
-			} else {
-				shmseg_ = xcb_generate_id(&xConnection());
+	auto newBytes = stride(size[0]) * size[1]; // the needed size
+
+	// we alloc more than is really needed because this will
+	// speed up (especially the shm version) resizes. We don't have to reallocated
+	// every time the window is resized and redrawn for the cost of higher memory
+	// consumption
+	auto age = 0u;
+	if(shm_) {
+		segment_ = acquireSegment();
+		auto& segment = segments_[segment_];
+		if(newBytes > segment.byteSize && !allocate(segment, newBytes * 4)) {
+			// e.g. when the SysV shm limits are exceeded. Continue without shm
+			dlg_warn("creating shm segment failed, falling back to put_image");
+			for(auto& seg : segments_) {
+				destroy(seg);
 			}
 
-			shmid_ = shmget(IPC_PRIVATE, byteSize_, IPC_CREAT | 0777);
-			data_ = static_cast<uint8_t*>(shmat(shmid_, 0, 0));
-			shmseg_ = xcb_generate_id(&xConnection());
-			xcb_shm_attach(&xConnection(), shmseg_, shmid_, 0);
+			segments_.clear();
+			shm_ = false;
+			present_ = false;
 		} else {
+			if(segment.presented && segment.size == size) {
+				age = presentCount_ - segment.presented + 1;
+			}
+
+			segment.size = size;
+			data_ = segment.data;
+		}
+	}
+
+	if(!shm_) {
+		if(newBytes > byteSize_) {
+			byteSize_ = newBytes * 4;
 			ownedBuffer_ = std::make_unique<uint8_t[]>(byteSize_);
 			data_ = ownedBuffer_.get();
+			presented_ = false;
 		}
+
+		// there is only one buffer, so it holds the last frame if it was
+		// presented with the same size
+		age = (presented_ && size == size_) ? 1u : 0u;
 	}
 
 	size_ = size;
 	active_ = true;
 
-	return {*this, {data_, {size_[0], size_[1]}, format_, size_[0] * bitSize(format_)}};
+	return {*this, {data_, {size_[0], size_[1]}, format_, stride(size_[0]) * 8}, age};
+}
+
+unsigned int X11BufferSurface::acquireSegment()
+{
+	// prefer the idle segment that was presented most recently since it needs
+	// the least redrawing (see BufferGuard::age)
+	auto best = -1;
+	for(auto i = 0u; i < segments_.size(); ++i) {
+		auto& segment = segments_[i];
+		if(!segment.busy && (best < 0 || segment.presented > segments_[best].presented)) {
+			best = i;
+		}
+	}
+
+	if(best >= 0) {
+		return best;
+	}
+
+	if(segments_.size() < maxSegments_) {
+		segments_.emplace_back();
+		return segments_.size() - 1;
+	}
+
+	// all segments are busy
+	if(present_) {
+		// wait until the server releases one of the pixmaps
+		auto& ac = windowContext().appContext();
+		auto idle = [&](const x11::GenericEvent& ev) {
+			auto& pev = reinterpret_cast<const xcb_present_idle_notify_event_t&>(ev);
+			return pev.response_type == XCB_GE_GENERIC &&
+				pev.extension == ac.presentOpcode() &&
+				pev.event_type == XCB_PRESENT_EVENT_IDLE_NOTIFY &&
+				pev.event == presentEventID_;
+		};
+
+		auto busy = [&]{
+			return std::all_of(segments_.begin(), segments_.end(),
+				[](auto& segment) { return segment.busy; });
+		};
+
+		while(busy() && ac.waitFor(idle));
+		if(!busy()) {
+			return acquireSegment();
+		}
+
+		// connection error, no reason to wait
+	} else {
+		// The server reads the segment while processing the shm_put_image
+		// request, so after a round trip all segments can be reused.
+		// Completion events for them arriving later on are ignored.
+		auto cookie = xcb_get_input_focus(&xConnection());
+		auto reply = xcb_get_input_focus_reply(&xConnection(), cookie, nullptr);
+		if(reply) free(reply);
+	}
+
+	best = 0;
+	for(auto i = 0u; i < segments_.size(); ++i) {
+		segments_[i].busy = false;
+		if(segments_[i].presented > segments_[best].presented) {
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+bool X11BufferSurface::allocate(Segment& segment, unsigned int byteSize)
+{
+	// the pixmap will be recreated for the new memory
+	if(segment.pixmap) {
+		xcb_free_pixmap(&xConnection(), segment.pixmap);
+		segment.pixmap = {};
+	}
+
+	if(shmFd_) {
+		if(allocateFd(segment, byteSize)) {
+			return true;
+		}
+
+		dlg_warn("creating memfd shm segment failed, falling back to SysV shm");
+		shmFd_ = false;
+	}
+
+	destroy(segment);
+
+	auto shmid = shmget(IPC_PRIVATE, byteSize, IPC_CREAT | 0600);
+	if(shmid < 0) {
+		dlg_warn("shmget failed: {}", std::strerror(errno));
+		return false;
+	}
+
+	auto data = shmat(shmid, nullptr, 0);
+	if(data == reinterpret_cast<void*>(-1)) {
+		dlg_warn("shmat failed: {}", std::strerror(errno));
+		shmctl(shmid, IPC_RMID, nullptr);
+		return false;
+	}
+
+	segment.byteSize = byteSize;
+	segment.shmid = shmid;
+	segment.data = static_cast<uint8_t*>(data);
+	segment.seg = xcb_generate_id(&xConnection());
+	segment.presented = 0u;
+
+	auto c = xcb_shm_attach(&xConnection(), segment.seg, segment.shmid, 0);
+	windowContext().appContext().errorCategory().watch(c, "ny::X11BufferSurface: shm_attach");
+
+	// on linux, segments marked for removal can still be attached (by the server).
+	// Removing it now makes sure it is not leaked if we crash
+	shmctl(segment.shmid, IPC_RMID, 0);
+	return true;
+}
+
+bool X11BufferSurface::allocateFd(Segment& segment, unsigned int byteSize)
+{
+	// memfd pages are only allocated when touched, so we can reserve enough for
+	// a window covering the whole screen. Resizes then don't have to reallocate
+	auto& screen = windowContext().appContext().xDefaultScreen();
+	auto screenBytes = stride(screen.width_in_pixels) * screen.height_in_pixels;
+	byteSize = std::max(byteSize, screenBytes);
+
+	if(segment.fd < 0) {
+		segment.fd = createMemfd("ny-x11-shm", byteSize);
+		if(segment.fd < 0) {
+			return false;
+		}
+
+		auto ptr = mmap(nullptr, byteSize, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fd, 0);
+		if(ptr == MAP_FAILED) {
+			close(segment.fd);
+			segment.fd = -1;
+			return false;
+		}
+
+		segment.data = static_cast<uint8_t*>(ptr);
+	} else {
+		// grow the existing file, no new memory has to be created
+		if(ftruncate(segment.fd, byteSize) < 0) {
+			return false;
+		}
+
+		auto ptr = mremap(segment.data, segment.byteSize, byteSize, MREMAP_MAYMOVE);
+		if(ptr == MAP_FAILED) {
+			return false;
+		}
+
+		segment.data = static_cast<uint8_t*>(ptr);
+	}
+
+	segment.byteSize = byteSize;
+	segment.presented = 0u;
+
+	// the server maps the file with the size it has at attach time, so it
+	// has to be attached again after growing. xcb closes the passed fd
+	auto fd = fcntl(segment.fd, F_DUPFD_CLOEXEC, 0);
+	if(fd < 0) {
+		return false;
+	}
+
+	if(segment.seg) {
+		xcb_shm_detach(&xConnection(), segment.seg);
+	}
+
+	segment.seg = xcb_generate_id(&xConnection());
+	auto c = xcb_shm_attach_fd(&xConnection(), segment.seg, fd, 0);
+	windowContext().appContext().errorCategory().watch(c, "ny::X11BufferSurface: shm_attach_fd");
+	return true;
 }
 
-void X11BufferSurface::apply(const BufferGuard&) noexcept
+void X11BufferSurface::destroy(Segment& segment)
+{
+	if(segment.pixmap) {
+		xcb_free_pixmap(&xConnection(), segment.pixmap);
+	}
+
+	if(segment.seg) {
+		xcb_shm_detach(&xConnection(), segment.seg);
+	}
+
+	if(segment.fd >= 0) {
+		munmap(segment.data, segment.byteSize);
+		close(segment.fd);
+	} else if(segment.data) {
+		shmdt(segment.data);
+	}
+
+	segment = {};
+}
+
+void X11BufferSurface::shmCompletion(uint32_t shmseg, uint32_t sequence)
+{
+	// a segment may be presented with multiple requests (one per damage rect)
+	// so it is only idle when the last one has completed
+	for(auto& segment : segments_) {
+		if(segment.seg == shmseg && segment.busy &&
+				static_cast<std::int32_t>(sequence - segment.request) >= 0) {
+			segment.busy = false;
+		}
+	}
+}
+
+void X11BufferSurface::apply(const BufferGuard& guard) noexcept
 {
 	if(!active_) {
 		dlg_warn("no currently active BufferGuard");
@@ -144,28 +392,224 @@ void X11BufferSurface::apply(const BufferGuard&) noexcept
 
 	active_ = false;
 
-	// XXX: we use the checked versions here since those function are very error prone due to
-	// the rather complex depth/visual/bpp x system. We catch invalid x request here
-	// directly.
-	// maybe remove this later on if tested enough?
+	if(present_) {
+		applyPresent(segments_[segment_]);
+		return;
+	}
+
+	// only the damaged regions are uploaded. The shm version can upload
+	// arbitrary rectangles of the image, otherwise bands of rows clipped
+	// to the damage are uploaded (see putImage).
+	auto damage = guard.damage();
+	if(guard.fullDamage()) {
+		damage = {{{0u, 0u}, size_}};
+	}
+
+	if(!shm_) {
+		presented_ = true;
+		putImage(damage);
+		return;
+	}
 
+	// The requests are error prone due to the rather complex depth/visual/bpp x
+	// system. Instead of checking them (one round trip per frame) they are
+	// sent unchecked and their errors reported asynchronously when they
+	// arrive in the event queue. In synchronous (debug) mode they are checked.
+	auto& errorCategory = windowContext().appContext().errorCategory();
+	auto sync = errorCategory.synchronous();
 	auto depth = windowContext().visualDepth();
 	auto window = windowContext().xWindow();
-	if(shm_) {
-		auto cookie = xcb_shm_put_image_checked(&xConnection(), window, gc_, size_[0], size_[1],
-			0, 0, size_[0], size_[1], 0, 0, depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, shmseg_, 0);
-		windowContext().errorCategory().checkWarn(cookie, "ny::X11BufferSurface: shm_put_image");
+
+	// request a completion event so we know when the segment can be reused
+	auto& segment = segments_[segment_];
+	auto put = sync ? &xcb_shm_put_image_checked : &xcb_shm_put_image;
+	std::vector<xcb_void_cookie_t> cookies;
+	for(auto& rect : damage) {
+		auto x = rect.position[0], y = rect.position[1];
+		cookies.push_back(put(&xConnection(), window, gc_,
+			size_[0], size_[1], x, y, rect.size[0], rect.size[1], x, y, depth,
+			XCB_IMAGE_FORMAT_Z_PIXMAP, 1, segment.seg, 0));
+	}
+
+	segment.presented = ++presentCount_;
+	if(!cookies.empty()) {
+		segment.busy = true;
+		segment.request = cookies.back().sequence;
+	}
+
+	// all requests are sent before the first one is checked, so synchronous
+	// mode results in only one roundtrip
+	auto msg = "ny::X11BufferSurface: shm_put_image";
+	for(auto cookie : cookies) {
+		if(sync) {
+			errorCategory.checkWarn(cookie, msg);
+		} else {
+			errorCategory.watch(cookie, msg);
+		}
+	}
+}
+
+void X11BufferSurface::putImage(nytl::Span<const nytl::Rect2ui> damage)
+{
+	// merge the row ranges of the damaged rects so no row is uploaded twice.
+	// The merged bands are clipped to the damaged columns
+	struct Band {
+		unsigned int begin, end; // rows
+		unsigned int left, right; // columns
+	};
+
+	std::vector<Band> bands;
+	for(auto& rect : damage) {
+		auto x = rect.position[0], y = rect.position[1];
+		bands.push_back({y, y + rect.size[1], x, x + rect.size[0]});
+	}
+
+	std::sort(bands.begin(), bands.end(),
+		[](auto& a, auto& b) { return a.begin < b.begin; });
+
+	auto merged = 0u;
+	for(auto i = 0u; i < bands.size(); ++merged) {
+		auto band = bands[i];
+		while(++i < bands.size() && bands[i].begin <= band.end) {
+			band.end = std::max(band.end, bands[i].end);
+			band.left = std::min(band.left, bands[i].left);
+			band.right = std::max(band.right, bands[i].right);
+		}
+
+		bands[merged] = band;
+	}
+
+	bands.resize(merged);
+
+	// a single request must not exceed the maximum request length (which
+	// already respects BIG-REQUESTS since xcb enables it if available),
+	// otherwise the connection is closed. It is given in 4 byte units and
+	// includes the request header (28 bytes with BIG-REQUESTS).
+	// Bands are therefore split into chunks of rows. The requests are only
+	// queued here, xcb writes them out as its buffer fills, so there
+	// are no intermediate flushes or round trips.
+	auto maxBytes = xcb_get_maximum_request_length(&xConnection()) * 4u - 28u;
+
+	auto& errorCategory = windowContext().appContext().errorCategory();
+	auto sync = errorCategory.synchronous();
+	auto put = sync ? &xcb_put_image_checked : &xcb_put_image;
+	auto depth = windowContext().visualDepth();
+	auto window = windowContext().xWindow();
+	auto bpp = bitSize(format_);
+	auto fullStride = stride(size_[0]);
+
+	std::vector<xcb_void_cookie_t> cookies;
+	for(auto& band : bands) {
+		auto width = band.right - band.left;
+		auto bandStride = stride(width);
+		auto maxRows = std::max(maxBytes / bandStride, 1u);
+
+		for(auto y = band.begin; y < band.end;) {
+			auto rows = std::min(maxRows, band.end - y);
+			auto src = data_ + y * fullStride + band.left * bpp / 8;
+
+			// clipped rows are not contiguous in the buffer, so they are packed
+			// into the staging buffer. xcb is done with the data when the
+			// request function returns, so it can be reused for the next one
+			const uint8_t* data = src;
+			if(width != size_[0]) {
+				packed_.resize(rows * bandStride);
+				for(auto r = 0u; r < rows; ++r) {
+					std::memcpy(packed_.data() + r * bandStride, src + r * fullStride,
+						width * bpp / 8);
+				}
+
+				data = packed_.data();
+			}
+
+			cookies.push_back(put(&xConnection(), XCB_IMAGE_FORMAT_Z_PIXMAP, window,
+				gc_, width, rows, band.left, y, 0, depth, rows * bandStride, data));
+			y += rows;
+		}
+	}
+
+	auto msg = "ny::X11BufferSurface: put_image";
+	for(auto cookie : cookies) {
+		if(sync) {
+			errorCategory.checkWarn(cookie, msg);
+		} else {
+			errorCategory.watch(cookie, msg);
+		}
+	}
+}
+
+unsigned int X11BufferSurface::stride(unsigned int width) const
+{
+	auto bits = width * bitSize(format_);
+	return ((bits + scanlinePad_ - 1) / scanlinePad_) * scanlinePad_ / 8;
+}
+
+void X11BufferSurface::applyPresent(Segment& segment)
+{
+	auto& errorCategory = windowContext().appContext().errorCategory();
+	auto sync = errorCategory.synchronous();
+	auto window = windowContext().xWindow();
+
+	// the pixmap has to be recreated when the size changes
+	if(!segment.pixmap || segment.pixmapSize != size_) {
+		if(segment.pixmap) {
+			xcb_free_pixmap(&xConnection(), segment.pixmap);
+		}
+
+		segment.pixmap = xcb_generate_id(&xConnection());
+		segment.pixmapSize = size_;
+
+		auto create = sync ? &xcb_shm_create_pixmap_checked : &xcb_shm_create_pixmap;
+		auto c = create(&xConnection(), segment.pixmap, window, size_[0], size_[1],
+			windowContext().visualDepth(), segment.seg, 0);
+		if(sync) {
+			errorCategory.checkWarn(c, "ny::X11BufferSurface: shm_create_pixmap");
+		} else {
+			errorCategory.watch(c, "ny::X11BufferSurface: shm_create_pixmap");
+		}
+	}
+
+	// the pixmap always holds the complete contents (see BufferGuard::age)
+	// so there is no need for valid/update regions
+	segment.presented = ++presentCount_;
+	segment.busy = true;
+
+	auto presentPixmap = sync ? &xcb_present_pixmap_checked : &xcb_present_pixmap;
+	auto c = presentPixmap(&xConnection(), window, segment.pixmap, presentCount_,
+		0, 0, 0, 0, 0, 0, 0, XCB_PRESENT_OPTION_NONE, 0, 0, 0, 0, nullptr);
+	if(sync) {
+		errorCategory.checkWarn(c, "ny::X11BufferSurface: present_pixmap");
 	} else {
-		auto length = std::ceil(size_[0] * size_[1] * bitSize(format_) / 8.0);
-		auto cookie = xcb_put_image_checked(&xConnection(), XCB_IMAGE_FORMAT_Z_PIXMAP, window,
-			gc_, size_[0], size_[1], 0, 0, 0, depth, length, data_);
-		windowContext().errorCategory().checkWarn(cookie, "ny::X11BufferSurface: put_image");
+		errorCategory.watch(c, "ny::X11BufferSurface: present_pixmap");
+	}
+}
+
+void X11BufferSurface::presentEvent(const x11::GenericEvent& ev)
+{
+	auto& gev = reinterpret_cast<const xcb_present_generic_event_t&>(ev);
+	if(gev.event != presentEventID_) {
+		return;
+	}
+
+	if(gev.evtype == XCB_PRESENT_EVENT_IDLE_NOTIFY) {
+		auto& idle = reinterpret_cast<const xcb_present_idle_notify_event_t&>(ev);
+		for(auto& segment : segments_) {
+			if(segment.pixmap == idle.pixmap) {
+				segment.busy = false;
+			}
+		}
+	} else if(gev.evtype == XCB_PRESENT_EVENT_COMPLETE_NOTIFY) {
+		auto& complete = reinterpret_cast<const xcb_present_complete_notify_event_t&>(ev);
+		if(complete.kind == XCB_PRESENT_COMPLETE_KIND_PIXMAP) {
+			onPresent(*this, complete.ust, complete.msc);
+		}
 	}
 }
 
 // X11BufferWindowContext
 X11BufferWindowContext::X11BufferWindowContext(X11AppContext& ac, const X11WindowSettings& settings)
-	: X11WindowContext(ac, settings), bufferSurface_(*this)
+	: X11WindowContext(ac, settings),
+		bufferSurface_(*this, settings.buffer.maxBuffers, settings.bufferPresent)
 {
 	// TODO: we could implement a custom visual querying here
 	// we need to find a visual with a known format
@@ -179,4 +623,14 @@ Surface X11BufferWindowContext::surface()
 	return {bufferSurface_};
 }
 
+void X11BufferWindowContext::shmCompletionEvent(uint32_t shmseg, uint32_t sequence)
+{
+	bufferSurface_.shmCompletion(shmseg, sequence);
+}
+
+void X11BufferWindowContext::presentEvent(const x11::GenericEvent& ev)
+{
+	bufferSurface_.presentEvent(ev);
+}
+
 } // namespace ny
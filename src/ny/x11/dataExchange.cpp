@@ -195,11 +195,11 @@ nytl::UniqueConnection X11DataOffer::registerDataRequest(const DataFormat& forma
 
 	// request the data in the target format from the selection owner that offers the data
 	// we request the owner to store it into the clipboard atom property of the dummy window
-	auto cookie = xcb_convert_selection_checked(&appContext().xConnection(),
+	auto cookie = xcb_convert_selection(&appContext().xConnection(),
 		appContext().xDummyWindow(), selection_, target,
 		appContext().atoms().clipboard, XCB_CURRENT_TIME);
 
-	appContext().errorCategory().checkWarn(cookie, "ny::X11DataOffer::registerDataRequest:0");
+	appContext().errorCategory().watch(cookie, "ny::X11DataOffer::registerDataRequest:0");
 
 	// add a callback to the pending data callbacks that will be triggered as soon
 	// as we receive the data in the requested format this callback will unregister itself.
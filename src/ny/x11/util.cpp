@@ -10,7 +10,7 @@
 
 #include <X11/Xlib.h>
 
-#include <algorithm> // std::sort
+#include <algorithm> // std::sort, std::find_if
 #include <unordered_map> // std::unordered_map
 #include <shared_mutex> // std::shared_timed_mutex
 #include <mutex> // std::lock_guard
@@ -79,7 +79,8 @@ X11ErrorCategory::X11ErrorCategory(Display& dpy, xcb_connection_t& conn)
 }
 
 X11ErrorCategory::X11ErrorCategory(X11ErrorCategory&& other)
-	: xDisplay_(other.xDisplay_), xConnection_(other.xConnection_)
+	: xDisplay_(other.xDisplay_), xConnection_(other.xConnection_),
+		watched_(std::move(other.watched_)), synchronous_(other.synchronous_)
 {
 	other.xDisplay_ = {};
 	other.xConnection_ = {};
@@ -94,6 +95,8 @@ X11ErrorCategory& X11ErrorCategory::operator=(X11ErrorCategory&& other)
 
 	xDisplay_ = other.xDisplay_;
 	xConnection_ = other.xConnection_;
+	watched_ = std::move(other.watched_);
+	synchronous_ = other.synchronous_;
 
 	if(xDisplay_) {
 		std::lock_guard<std::shared_timed_mutex> lock(errorCategoriesMutex);
@@ -175,6 +178,44 @@ void X11ErrorCategory::checkThrow(xcb_void_cookie_t cookie, std::string_view msg
 	if(!check(cookie, ec)) throw std::system_error(ec, std::string(msg));
 }
 
+void X11ErrorCategory::watch(xcb_void_cookie_t cookie, const char* context)
+{
+	// xcb only gives us the lower 32 bits of the sequence number which
+	// is enough to match it with the full_sequence of errors
+	if(watched_.size() >= maxWatched) {
+		watched_.pop_front();
+	}
+
+	watched_.push_back({cookie.sequence, context});
+}
+
+bool X11ErrorCategory::handleError(const xcb_generic_error_t& error)
+{
+	auto errorMsg = x11::errorMessage(*xDisplay_, error.error_code);
+	auto it = std::find_if(watched_.begin(), watched_.end(),
+		[&](auto& w) { return w.sequence == error.full_sequence; });
+
+	if(it == watched_.end()) {
+		dlg_warn("retrieved error code {}, {}", (int) error.error_code, errorMsg);
+		return false;
+	}
+
+	dlg_warn("error code {}, {}: {}", (int) error.error_code, errorMsg, it->context);
+	watched_.erase(it);
+	return true;
+}
+
+void X11ErrorCategory::processed(std::uint32_t fullSequence)
+{
+	// errors are delivered in request order, so requests older than the
+	// sequence of a received event cannot generate an error anymore.
+	// The signed difference handles sequence wraparound
+	while(!watched_.empty() &&
+			static_cast<std::int32_t>(fullSequence - watched_.front().sequence) > 0) {
+		watched_.pop_front();
+	}
+}
+
 namespace x11 {
 
 Property readProperty(xcb_connection_t& connection, xcb_atom_t atom, xcb_window_t window,
@@ -225,10 +266,10 @@ std::string errorMessage(Display& dpy, unsigned int error)
 	return buffer;
 }
 
-ImageFormat visualToFormat(const xcb_visualtype_t& v, unsigned int depth)
+ImageFormat visualToFormat(const xcb_visualtype_t& v, unsigned int depth, unsigned int bpp)
 {
 	using Format = ImageFormat;
-	if(depth != 24 && depth != 32) {
+	if(depth != 16 && depth != 24 && depth != 30 && depth != 32) {
 		return Format::none;
 	}
 
@@ -247,6 +288,9 @@ ImageFormat visualToFormat(const xcb_visualtype_t& v, unsigned int depth)
 		{ 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0xFF000000u, Format::argb8888 },
 		{ 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0u, Format::rgb888 },
 		{ 0x000000FFu, 0x0000FF00u, 0x00FF0000u, 0u, Format::bgr888 },
+		{ 0x0000F800u, 0x000007E0u, 0x0000001Fu, 0u, Format::rgb565 },
+		{ 0x3FF00000u, 0x000FFC00u, 0x000003FFu, 0u, Format::xrgb2101010 },
+		{ 0x3FF00000u, 0x000FFC00u, 0x000003FFu, 0xC0000000u, Format::xrgb2101010 },
 
 		{ 0xFF000000u, 0u, 0u, 0u, Format::a8 },
 		{ 0x000000FFu, 0u, 0u, 0u, Format::a8 },
@@ -259,11 +303,39 @@ ImageFormat visualToFormat(const xcb_visualtype_t& v, unsigned int depth)
 		a = 0xFFFFFFFFu & ~(v.red_mask | v.green_mask | v.blue_mask);
 	}
 
-	for(auto& f : formats)
-		if(v.red_mask == f.r && v.green_mask == f.g && v.blue_mask == f.b && a == f.a)
-			return f.format;
+	auto format = Format::none;
+	for(auto& f : formats) {
+		if(v.red_mask == f.r && v.green_mask == f.g && v.blue_mask == f.b && a == f.a) {
+			format = f.format;
+			break;
+		}
+	}
+
+	// without alpha, 24 bit depth is usually padded to 32 bits per pixel
+	if(bpp == 32 && format == Format::rgb888) {
+		format = Format::xrgb8888;
+	} else if(bpp == 32 && format == Format::bgr888) {
+		format = Format::xbgr8888;
+	}
+
+	if(format == Format::none || bitSize(format) != bpp) {
+		return Format::none;
+	}
 
-	return Format::none;
+	return format;
+}
+
+unsigned int bitsPerPixel(const xcb_setup_t& setup, unsigned int depth)
+{
+	auto fmtit = xcb_setup_pixmap_formats(&setup);
+	auto fmtend = fmtit + xcb_setup_pixmap_formats_length(&setup);
+	for(; fmtit != fmtend; ++fmtit) {
+		if(fmtit->depth == depth) {
+			return fmtit->bits_per_pixel;
+		}
+	}
+
+	return 0u;
 }
 
 unsigned int visualDepth(xcb_screen_t& screen, unsigned int visualID)
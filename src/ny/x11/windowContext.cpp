@@ -190,9 +190,9 @@ void X11WindowContext::initVisual(const X11WindowSettings& settings)
 			return 3u + settings.transparent * 10;
 		} else if(f == ImageFormat::bgra8888) {
 			return 2u + settings.transparent * 10;
-		} else if(f == ImageFormat::rgb888) {
+		} else if(f == ImageFormat::rgb888 || f == ImageFormat::xrgb8888) {
 			return 3u + !settings.transparent * 10;
-		} else if(f == ImageFormat::bgr888) {
+		} else if(f == ImageFormat::bgr888 || f == ImageFormat::xbgr8888) {
 			return 2u + !settings.transparent * 10;
 		}
 
@@ -208,7 +208,8 @@ void X11WindowContext::initVisual(const X11WindowSettings& settings)
 		auto visual_iter = xcb_depth_visuals_iterator(depth_iter.data);
 		for(; visual_iter.rem; xcb_visualtype_next(&visual_iter)) {
 			auto depth = depth_iter.data->depth;
-			auto vformat = x11::visualToFormat(*visual_iter.data, depth);
+			auto bpp = x11::bitsPerPixel(*xcb_get_setup(&xConnection()), depth);
+			auto vformat = x11::visualToFormat(*visual_iter.data, depth, bpp);
 			auto s = score(vformat);
 			if(s > highestScore) {
 				visualID_ = visual_iter.data->visual_id;
@@ -524,6 +525,14 @@ void X11WindowContext::reparentEvent()
 	position(settings_.position);
 }
 
+void X11WindowContext::shmCompletionEvent(uint32_t, uint32_t)
+{
+}
+
+void X11WindowContext::presentEvent(const x11::GenericEvent&)
+{
+}
+
 void X11WindowContext::customDecorated(bool set)
 {
 	typedef struct {
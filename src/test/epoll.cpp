@@ -0,0 +1,91 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <ny/common/epoll.hpp> // ny::EpollLoop
+#include <nytl/connection.hpp> // nytl::Connection
+
+#include <unistd.h> // pipe, write, close
+#include <poll.h> // POLLIN
+
+#include <cstdio> // std::printf
+
+// Tests for ny::EpollLoop, mainly multiple callbacks for one fd and fds that
+// are closed before their callbacks are disconnected.
+// Returns a non-zero value if any of the checks failed.
+
+namespace {
+
+unsigned int failures {};
+
+void check(bool ok, const char* what)
+{
+	if(!ok) {
+		++failures;
+		std::printf("failed: %s\n", what);
+	}
+}
+
+} // anonymous namespace
+
+int main()
+{
+	ny::EpollLoop loop;
+	int fds[2];
+	if(pipe(fds) < 0) {
+		std::printf("pipe failed\n");
+		return 1;
+	}
+
+	// two callbacks for one fd, the fd is closed before they are disconnected
+	auto first = 0u, second = 0u;
+	auto c1 = loop.add(fds[0], POLLIN, [&](int, unsigned int) { ++first; return true; });
+	auto c2 = loop.add(fds[0], POLLIN, [&](int, unsigned int) { ++second; return true; });
+
+	check(write(fds[1], "x", 1) == 1, "write");
+	check(loop.dispatch(0) == 2 && first == 1 && second == 1, "multiple callbacks");
+
+	close(fds[0]);
+	int reused[2]; // probably gets the closed fd number
+	check(pipe(reused) == 0, "pipe");
+
+	c1.disconnect();
+	check(loop.dispatch(0) == 1 && first == 1 && second == 2, "disconnect after close");
+
+	c2.disconnect();
+	check(loop.dispatch(0) == 0 && first == 1 && second == 2, "disconnect all");
+
+	// the registrations for the reused fd number must not be affected
+	loop.add(reused[0], POLLIN, [&](int, unsigned int) { return false; });
+	check(write(reused[1], "x", 1) == 1, "write");
+	check(loop.dispatch(0) == 1, "reused fd");
+	check(loop.dispatch(0) == 0, "disconnect by return value");
+
+	// disconnecting another ready callback while dispatching
+	nytl::Connection c3, c4;
+	auto called = 0u;
+	c3 = loop.add(reused[0], POLLIN, [&](int, unsigned int) {
+		++called;
+		c4.disconnect();
+		return true;
+	});
+	c4 = loop.add(reused[0], POLLIN, [&](int, unsigned int) {
+		++called;
+		c3.disconnect();
+		return true;
+	});
+
+	loop.dispatch(0);
+	check(called == 1, "disconnect while dispatching");
+
+	close(reused[0]);
+	close(reused[1]);
+	close(fds[1]);
+
+	if(failures) {
+		std::printf("%u checks failed\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
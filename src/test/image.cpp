@@ -0,0 +1,1002 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <ny/image.hpp> // ny::readPixel, ny::convertFormat, ...
+#include <ny/dataExchange.hpp> // ny::serialize, ny::deserializeImage
+#include <ny/formatTraits.hpp> // ny::FormatTraits, ny::forEachPixel
+
+#include <algorithm> // std::min
+#include <cmath> // std::lround
+#include <cstdint> // std::uint64_t, std::uintptr_t
+#include <cstdio> // std::printf
+#include <cstring> // std::memcpy
+#include <new> // std::align_val_t
+#include <random> // std::mt19937
+#include <stdexcept> // std::logic_error
+#include <utility> // std::pair
+#include <vector> // std::vector
+
+// Tests for the ny/image functions. Does not need a display server.
+// Compares the functions against the simple scalar reference implementation below,
+// which is written independently of ny::FormatTraits.
+// Prints every failed check and returns a non-zero value if there were any.
+
+namespace {
+
+using ny::ImageFormat;
+
+constexpr ImageFormat formats[] = {
+	ImageFormat::rgba8888,
+	ImageFormat::argb8888,
+	ImageFormat::rgb888,
+	ImageFormat::abgr8888,
+	ImageFormat::bgra8888,
+	ImageFormat::bgr888,
+	ImageFormat::a8,
+	ImageFormat::a1,
+	ImageFormat::xrgb8888,
+	ImageFormat::xbgr8888,
+	ImageFormat::rgb565,
+	ImageFormat::xrgb2101010,
+	ImageFormat::rgba16f,
+};
+
+const char* name(ImageFormat format)
+{
+	switch(format) {
+		case ImageFormat::rgba8888: return "rgba8888";
+		case ImageFormat::argb8888: return "argb8888";
+		case ImageFormat::rgb888: return "rgb888";
+		case ImageFormat::abgr8888: return "abgr8888";
+		case ImageFormat::bgra8888: return "bgra8888";
+		case ImageFormat::bgr888: return "bgr888";
+		case ImageFormat::a8: return "a8";
+		case ImageFormat::a1: return "a1";
+		case ImageFormat::xrgb8888: return "xrgb8888";
+		case ImageFormat::xbgr8888: return "xbgr8888";
+		case ImageFormat::rgb565: return "rgb565";
+		case ImageFormat::xrgb2101010: return "xrgb2101010";
+		case ImageFormat::rgba16f: return "rgba16f";
+		default: return "none";
+	}
+}
+
+unsigned int failures {};
+
+// Prints the failed check (only the first few of one kind).
+bool check(bool ok, const char* what, ImageFormat format,
+		ImageFormat other = ImageFormat::none)
+{
+	if(!ok && ++failures <= 50) {
+		std::printf("failed: %s (%s", what, name(format));
+		if(other != ImageFormat::none) std::printf(" -> %s", name(other));
+		std::printf(")\n");
+	}
+
+	return ok;
+}
+
+// - scalar reference -
+// Layout of a format as pixel word (in word order). Channels are r, g, b, a.
+struct Layout {
+	unsigned int bits;
+	int shifts[4]; // -1 if the channel is not present
+	unsigned int depths[4];
+	bool halfFloat;
+};
+
+Layout layout(ImageFormat format)
+{
+	switch(format) {
+		case ImageFormat::rgba8888: return {32, {24, 16, 8, 0}, {8, 8, 8, 8}, false};
+		case ImageFormat::argb8888: return {32, {16, 8, 0, 24}, {8, 8, 8, 8}, false};
+		case ImageFormat::rgb888: return {24, {16, 8, 0, -1}, {8, 8, 8, 0}, false};
+		case ImageFormat::abgr8888: return {32, {0, 8, 16, 24}, {8, 8, 8, 8}, false};
+		case ImageFormat::bgra8888: return {32, {8, 16, 24, 0}, {8, 8, 8, 8}, false};
+		case ImageFormat::bgr888: return {24, {0, 8, 16, -1}, {8, 8, 8, 0}, false};
+		case ImageFormat::a8: return {8, {-1, -1, -1, 0}, {0, 0, 0, 8}, false};
+		case ImageFormat::a1: return {1, {-1, -1, -1, 0}, {0, 0, 0, 1}, false};
+		case ImageFormat::xrgb8888: return {32, {16, 8, 0, -1}, {8, 8, 8, 0}, false};
+		case ImageFormat::xbgr8888: return {32, {0, 8, 16, -1}, {8, 8, 8, 0}, false};
+		case ImageFormat::rgb565: return {16, {11, 5, 0, -1}, {5, 6, 5, 0}, false};
+		case ImageFormat::xrgb2101010: return {32, {20, 10, 0, -1}, {10, 10, 10, 0}, false};
+		case ImageFormat::rgba16f: return {64, {48, 32, 16, 0}, {16, 16, 16, 16}, true};
+		default: return {0, {-1, -1, -1, -1}, {0, 0, 0, 0}, false};
+	}
+}
+
+double halfToDouble(unsigned int half)
+{
+	auto sign = (half & 0x8000u) ? -1.0 : 1.0;
+	auto exp = int((half >> 10) & 0x1Fu);
+	auto mant = half & 0x3FFu;
+	if(exp == 0x1F) return mant ? NAN : sign * INFINITY;
+	if(!exp) return sign * std::ldexp(mant, -24);
+	return sign * std::ldexp(mant + 1024, exp - 25);
+}
+
+// Only for values in [0, 1]. Rounds to the nearest value, ties to even.
+unsigned int doubleToHalf(double value)
+{
+	if(value < std::ldexp(1.0, -14)) {
+		return std::nearbyint(std::ldexp(value, 24)); // 1024 is the smallest normal
+	}
+
+	auto exp = std::ilogb(value);
+	auto mant = std::nearbyint((std::ldexp(value, -exp) - 1.0) * 1024);
+	return ((exp + 15) << 10) + unsigned(mant); // mant 1024 carries into the exponent
+}
+
+// Loads/stores the pixel word. For a1 the word is the bit of the pixel.
+std::uint64_t loadWord(const std::uint8_t* p, ImageFormat format, unsigned int bit)
+{
+	auto bits = layout(format).bits;
+	if(bits == 1) {
+		return (p[0] >> (7 - bit)) & 1u;
+	}
+
+	std::uint64_t word = 0;
+	auto bytes = bits / 8;
+	for(auto i = 0u; i < bytes; ++i) {
+		auto significance = ny::littleEndian() ? i : bytes - 1 - i;
+		word |= std::uint64_t(p[i]) << (8 * significance);
+	}
+
+	return word;
+}
+
+void storeWord(std::uint8_t* p, ImageFormat format, std::uint64_t word, unsigned int bit)
+{
+	auto bits = layout(format).bits;
+	if(bits == 1) {
+		p[0] = (p[0] & ~(0x80u >> bit)) | ((word & 1u) << (7 - bit));
+		return;
+	}
+
+	auto bytes = bits / 8;
+	for(auto i = 0u; i < bytes; ++i) {
+		auto significance = ny::littleEndian() ? i : bytes - 1 - i;
+		p[i] = (word >> (8 * significance)) & 0xFFu;
+	}
+}
+
+nytl::Vec4u8 unpackRef(std::uint64_t word, ImageFormat format)
+{
+	auto l = layout(format);
+	nytl::Vec4u8 ret {};
+	for(auto i = 0u; i < 4u; ++i) {
+		if(l.shifts[i] < 0) continue;
+		auto max = (std::uint64_t(1) << l.depths[i]) - 1;
+		auto raw = (word >> l.shifts[i]) & max;
+		if(l.halfFloat) {
+			auto value = halfToDouble(raw);
+			value = (value > 0.0) ? std::min(value, 1.0) : 0.0;
+			ret[i] = std::lround(value * 255);
+		} else {
+			ret[i] = std::lround(raw * 255.0 / max);
+		}
+	}
+
+	return ret;
+}
+
+std::uint64_t packRef(nytl::Vec4u8 color, ImageFormat format)
+{
+	auto l = layout(format);
+	std::uint64_t ret = 0;
+	for(auto i = 0u; i < 4u; ++i) {
+		if(l.shifts[i] < 0) continue;
+		auto max = (std::uint64_t(1) << l.depths[i]) - 1;
+		std::uint64_t raw;
+		if(l.halfFloat) {
+			raw = doubleToHalf(color[i] / 255.f); // 8-bit value converted to float first
+		} else {
+			raw = std::lround(color[i] * double(max) / 255);
+		}
+
+		ret |= raw << l.shifts[i];
+	}
+
+	return ret;
+}
+
+nytl::Vec4u8 readRef(const std::uint8_t* p, ImageFormat format, unsigned int bit = 0)
+{
+	return unpackRef(loadWord(p, format, bit), format);
+}
+
+void writeRef(std::uint8_t* p, ImageFormat format, nytl::Vec4u8 color, unsigned int bit = 0)
+{
+	storeWord(p, format, packRef(color, format), bit);
+}
+
+// Returns the byte of the given pixel and sets bit to its bit offset.
+template<typename P>
+P pixelRef(const ny::BasicImage<P>& img, nytl::Vec2ui pos, unsigned int& bit)
+{
+	auto b = img.bitOffset + std::uint64_t(ny::bitStride(img)) * pos[1] +
+		std::uint64_t(pos[0]) * layout(img.format).bits;
+	bit = b % 8;
+	return img.data + b / 8;
+}
+
+nytl::Vec4u8 readRef(const ny::Image& img, nytl::Vec2ui pos)
+{
+	unsigned int bit;
+	auto p = pixelRef(img, pos, bit);
+	return readRef(p, img.format, bit);
+}
+
+std::uint64_t wordRef(const ny::Image& img, nytl::Vec2ui pos)
+{
+	unsigned int bit;
+	auto p = pixelRef(img, pos, bit);
+	return loadWord(p, img.format, bit);
+}
+
+// - test data -
+std::mt19937 rng(42u);
+
+nytl::Vec4u8 randomColor()
+{
+	auto v = rng();
+	return {std::uint8_t(v), std::uint8_t(v >> 8), std::uint8_t(v >> 16), std::uint8_t(v >> 24)};
+}
+
+// Owned image with random data. The stride has some padding and its rows are not
+// byte-aligned for a1, so that odd widths and bit offsets are covered.
+struct TestImage {
+	std::vector<std::uint8_t> data;
+	ny::MutableImage image;
+};
+
+TestImage createImage(nytl::Vec2ui size, ImageFormat format)
+{
+	auto bits = layout(format).bits;
+	auto stride = size[0] * bits + ((bits == 1) ? 5 : 16);
+
+	TestImage ret;
+	ret.data.resize((std::uint64_t(stride) * size[1] + 7) / 8);
+	for(auto& b : ret.data) {
+		b = rng() & 0xFFu;
+	}
+
+	ret.image = {ret.data.data(), size, format, stride};
+	return ret;
+}
+
+// View into the parent image at an odd offset with an odd width.
+ny::MutableImage view(const TestImage& img)
+{
+	auto size = img.image.size;
+	return ny::subImage(img.image, {3u, 1u}, {size[0] - 6u, size[1] - 2u});
+}
+
+constexpr nytl::Vec2ui imageSize = {19u, 7u};
+
+// - tests -
+// Single pixels with FormatTraits, readPixel and writePixel.
+void testPixels()
+{
+	for(auto format : formats) {
+		ny::visitFormat(format, [&](auto traits) {
+			using Traits = decltype(traits);
+			auto l = layout(format);
+			check(Traits::bitSize == l.bits && ny::bitSize(format) == l.bits, "bitSize", format);
+
+			for(auto i = 0u; i < 1000u; ++i) {
+				std::uint8_t bytes[16];
+				for(auto& b : bytes) b = rng() & 0xFFu;
+
+				auto offset = 1u + i % 7u; // unaligned memory
+				auto bit = (l.bits == 1) ? i % 8u : 0u;
+				auto p = bytes + offset;
+
+				auto ref = readRef(p, format, bit);
+				auto word = Traits::load(p, bit);
+				check(Traits::unpack(word) == ref, "FormatTraits::load/unpack", format);
+				check(Traits::read(p, bit) == ref, "FormatTraits::read", format);
+				check(ny::readPixel(*p, format, bit) == ref, "readPixel", format);
+				if(l.bits != 1) {
+					check(word == loadWord(p, format, bit), "FormatTraits::load word", format);
+				}
+
+				// writing must not change any other bits
+				auto color = randomColor();
+				std::uint8_t expected[16], traitsBytes[16], pixelBytes[16];
+				std::memcpy(expected, bytes, sizeof(bytes));
+				std::memcpy(traitsBytes, bytes, sizeof(bytes));
+				std::memcpy(pixelBytes, bytes, sizeof(bytes));
+
+				writeRef(expected + offset, format, color, bit);
+				Traits::store(traitsBytes + offset, Traits::pack(color), bit);
+				ny::writePixel(pixelBytes[offset], format, color, bit);
+
+				check(!std::memcmp(expected, traitsBytes, sizeof(bytes)),
+					"FormatTraits::pack/store", format);
+				check(!std::memcmp(expected, pixelBytes, sizeof(bytes)), "writePixel", format);
+				if(l.bits != 1) {
+					check(Traits::pack(color) == packRef(color, format),
+						"FormatTraits::pack word", format);
+				}
+			}
+		});
+	}
+}
+
+// forEachPixel and rowSpan, reading and writing, on a view with odd size and offset.
+void testForEachPixel()
+{
+	for(auto format : formats) {
+		auto img = createImage(imageSize, format);
+		auto sub = view(img);
+
+		auto visited = 0u;
+		ny::forEachPixel(sub, [&](nytl::Vec2ui pos, const nytl::Vec4u8& color) {
+			++visited;
+			check(color == readRef(sub, pos), "forEachPixel read", format);
+			check(color == ny::readPixel(sub, pos), "readPixel(Image)", format);
+		});
+		check(visited == sub.size[0] * sub.size[1], "forEachPixel count", format);
+
+		ny::visitFormat(format, [&](auto traits) {
+			using Traits = decltype(traits);
+			for(auto y = 0u; y < sub.size[1]; ++y) {
+				auto row = ny::rowSpan<Traits::format>(ny::Image(sub), y);
+				check(row.size() == sub.size[0], "rowSpan size", format);
+				for(auto x = 0u; x < row.size(); ++x) {
+					check(row[x] == readRef(sub, {x, y}), "rowSpan", format);
+				}
+			}
+		});
+
+		// write a color depending on the position and the old color
+		auto modify = [](nytl::Vec2ui pos, nytl::Vec4u8 color) {
+			return nytl::Vec4u8 {std::uint8_t(255 - color[0]), color[2],
+				std::uint8_t(pos[0] * 13), std::uint8_t(pos[1] * 40 + color[3])};
+		};
+
+		auto expected = img;
+		expected.image.data = expected.data.data();
+		auto expectedSub = view(expected);
+		for(auto y = 0u; y < sub.size[1]; ++y) {
+			for(auto x = 0u; x < sub.size[0]; ++x) {
+				unsigned int bit;
+				auto p = pixelRef(expectedSub, {x, y}, bit);
+				auto color = readRef(p, format, bit);
+				writeRef(p, format, modify({x, y}, color), bit);
+			}
+		}
+
+		auto copy = img;
+		copy.image.data = copy.data.data();
+		auto copySub = view(copy);
+
+		ny::forEachPixel(sub, [&](nytl::Vec2ui pos, nytl::Vec4u8& color) {
+			color = modify(pos, color);
+		});
+		check(img.data == expected.data, "forEachPixel write", format);
+
+		ny::visitFormat(format, [&](auto traits) {
+			using Traits = decltype(traits);
+			for(auto y = 0u; y < copySub.size[1]; ++y) {
+				auto row = ny::rowSpan<Traits::format>(copySub, y);
+				for(auto x = 0u; x < row.size(); ++x) {
+					row.set(x, modify({x, y}, row[x]));
+				}
+			}
+		});
+		check(copy.data == expected.data, "rowSpan set", format);
+	}
+}
+
+// convertFormat between every pair of formats.
+void testConvert()
+{
+	for(auto from : formats) {
+		auto img = createImage(imageSize, from);
+		auto src = view(img);
+
+		for(auto to : formats) {
+			for(auto align : {0u, 32u}) {
+				auto converted = ny::convertFormat(src, to, align);
+				auto ok = converted.format == to && converted.size == src.size;
+				if(align) ok &= ny::bitStride(converted) % align == 0;
+				check(ok, "convertFormat size/stride", from, to);
+				if(!ok) continue;
+
+				// the raw words must match, i.e. unused bits must be 0.
+				// Conversions into the same format copy the data.
+				auto dst = ny::Image(converted);
+				for(auto y = 0u; y < src.size[1]; ++y) {
+					for(auto x = 0u; x < src.size[0]; ++x) {
+						auto word = (from == to) ? wordRef(src, {x, y}) :
+							packRef(readRef(src, {x, y}), to);
+						ok &= wordRef(dst, {x, y}) == word;
+					}
+				}
+
+				check(ok, "convertFormat", from, to);
+			}
+		}
+	}
+}
+
+// premultiply and unpremultiply against the rounding rules documented in ny/image.hpp
+// and the bounds of a premultiply -> unpremultiply round trip.
+void testPremultiply()
+{
+	for(auto format : formats) {
+		auto img = createImage(imageSize, format);
+		auto sub = view(img);
+		if(!ny::alphaComponent(format)) {
+			auto copy = img.data;
+			ny::premultiply(sub);
+			ny::unpremultiply(sub);
+			check(copy == img.data, "premultiply without alpha", format);
+			continue;
+		}
+
+		// defined values for float formats, some fully transparent/opaque pixels
+		std::vector<nytl::Vec4u8> colors;
+		for(auto y = 0u; y < sub.size[1]; ++y) {
+			for(auto x = 0u; x < sub.size[0]; ++x) {
+				auto color = randomColor();
+				if(x == 0) color[3] = 0u;
+				if(x == 1) color[3] = 255u;
+				if(x == 2) color[3] = 1u;
+				ny::writePixel(sub, {x, y}, color);
+				colors.push_back(ny::readPixel(sub, {x, y}));
+			}
+		}
+
+		auto premultiplied = img;
+		premultiplied.image.data = premultiplied.data.data();
+		ny::premultiply(view(premultiplied));
+
+		auto converted = ny::convertPremultiply(sub, format);
+		auto convertedOk = true;
+
+		auto unpremultiplied = premultiplied;
+		unpremultiplied.image.data = unpremultiplied.data.data();
+		ny::unpremultiply(view(unpremultiplied));
+
+		auto half = layout(format).halfFloat;
+		for(auto y = 0u; y < sub.size[1]; ++y) {
+			for(auto x = 0u; x < sub.size[0]; ++x) {
+				auto color = colors[y * sub.size[0] + x];
+				auto pre = ny::readPixel(view(premultiplied), {x, y});
+				auto un = ny::readPixel(view(unpremultiplied), {x, y});
+				convertedOk &= ny::readPixel(converted, {x, y}) == pre;
+
+				auto a = color[3];
+				auto ok = pre[3] == a && un[3] == a;
+				for(auto c = 0u; c < 3u; ++c) {
+					if(half) { // float precision, only rounded when read
+						ok &= std::abs(pre[c] - color[c] * a / 255.0) <= 1.0;
+						ok &= !a || std::abs(un[c] - color[c]) <= 1;
+						continue;
+					}
+
+					ok &= pre[c] == std::lround(color[c] * a / 255.0);
+
+					// rounded to the nearest value, clamped
+					auto exact = a ? pre[c] * 255.0 / a : 0.0;
+					ok &= (un[c] == 255u && exact >= 254.5) || std::abs(un[c] - exact) <= 0.5;
+
+					// rounding error of premultiply, scaled up by unpremultiply
+					ok &= !a || std::abs(un[c] - color[c]) <= 127.5 / a + 0.5;
+				}
+
+				check(ok, "premultiply/unpremultiply", format);
+			}
+		}
+
+		check(convertedOk, "convertPremultiply", format);
+
+		// resetAlpha: same colors, alpha is zero
+		ny::premultiply(sub, true);
+		auto resetOk = true;
+		for(auto y = 0u; y < sub.size[1]; ++y) {
+			for(auto x = 0u; x < sub.size[0]; ++x) {
+				auto pre = ny::readPixel(view(premultiplied), {x, y});
+				pre[3] = 0u;
+				resetOk &= ny::readPixel(sub, {x, y}) == pre;
+			}
+		}
+
+		check(resetOk, "premultiply resetAlpha", format);
+	}
+}
+
+// convertFormatInPlace must give the same result as convertFormat and must not
+// touch the data outside of the image.
+void testConvertInPlace()
+{
+	for(auto from : formats) {
+		for(auto to : formats) {
+			auto img = createImage(imageSize, from);
+			auto sub = view(img);
+			if(ny::bitSize(from) != ny::bitSize(to)) {
+				auto thrown = false;
+				try {
+					ny::convertFormatInPlace(sub, to);
+				} catch(const std::logic_error&) {
+					thrown = true;
+				}
+
+				check(thrown, "convertFormatInPlace different sizes", from, to);
+				continue;
+			}
+
+			auto expected = ny::convertFormat(sub, to);
+
+			// expected parent data: converted pixels inside the view, the rest unchanged
+			auto expectedData = img.data;
+			for(auto y = 0u; y < sub.size[1]; ++y) {
+				for(auto x = 0u; x < sub.size[0]; ++x) {
+					unsigned int bit;
+					auto p = pixelRef(sub, {x, y}, bit);
+					storeWord(expectedData.data() + (p - img.data.data()), to,
+						wordRef(expected, {x, y}), bit);
+				}
+			}
+
+			auto converted = ny::convertFormatInPlace(sub, to);
+			auto ok = converted.data == sub.data && converted.format == to &&
+				converted.size == sub.size && converted.stride == sub.stride &&
+				converted.bitOffset == sub.bitOffset;
+			check(ok, "convertFormatInPlace view", from, to);
+			check(img.data == expectedData, "convertFormatInPlace", from, to);
+		}
+	}
+}
+
+// subImage views at every bit offset must read and write the pixels of the parent.
+void testSubImage()
+{
+	for(auto format : formats) {
+		auto img = createImage(imageSize, format);
+		const auto& parent = img.image;
+		auto end = img.data.data() + img.data.size();
+
+		for(auto oy = 0u; oy < 3u; ++oy) {
+			for(auto ox = 0u; ox < 9u; ++ox) {
+				nytl::Vec2ui offset {ox, oy};
+				nytl::Vec2ui size {imageSize[0] - ox - (ox % 3), imageSize[1] - oy};
+				auto sub = ny::subImage(parent, offset, size);
+
+				auto bit = ny::pixelBit(parent, offset);
+				auto ok = sub.data == parent.data + bit / 8 && sub.bitOffset == bit % 8 &&
+					sub.format == format && sub.size == size &&
+					ny::bitStride(sub) == ny::bitStride(parent);
+				ok &= sub.data + ny::dataSize(sub) <= end;
+				ok &= !ny::satisfiesRequirements(sub, format) || !sub.bitOffset;
+				check(ok, "subImage", format);
+
+				for(auto y = 0u; y < size[1]; ++y) {
+					for(auto x = 0u; x < size[0]; ++x) {
+						auto color = ny::readPixel(sub, {x, y});
+						ok &= color == ny::readPixel(parent, {x + ox, y + oy});
+						ok &= color == readRef(sub, {x, y});
+					}
+				}
+
+				check(ok, "subImage readPixel", format);
+
+				// views of views
+				auto nested = ny::subImage(sub, {1u, 1u}, {size[0] - 1, size[1] - 1});
+				auto direct = ny::subImage(parent, {ox + 1, oy + 1}, nested.size);
+				check(nested.data == direct.data && nested.bitOffset == direct.bitOffset,
+					"subImage nested", format);
+
+				// views with a bit offset are serialized as packed copies
+				auto serialized = ny::serialize(sub);
+				auto deserialized = ny::deserializeImage(serialized);
+				ok = deserialized.format == format && deserialized.size == size &&
+					!deserialized.bitOffset;
+				for(auto y = 0u; ok && y < size[1]; ++y) {
+					for(auto x = 0u; x < size[0]; ++x) {
+						ok &= ny::readPixel(deserialized, {x, y}) == readRef(sub, {x, y});
+					}
+				}
+
+				check(ok, "serialize subImage", format);
+			}
+		}
+
+		// writing through a view, everything else stays the same
+		auto sub = view(img);
+		auto expected = img.data;
+		for(auto y = 0u; y < sub.size[1]; ++y) {
+			for(auto x = 0u; x < sub.size[0]; ++x) {
+				auto color = randomColor();
+				unsigned int bit;
+				auto p = pixelRef(sub, {x, y}, bit);
+				writeRef(expected.data() + (p - img.data.data()), format, color, bit);
+				ny::writePixel(sub, {x, y}, color);
+			}
+		}
+
+		check(img.data == expected, "subImage writePixel", format);
+
+		// convertFormat into a view only changes the pixels of the view
+		for(auto from : formats) {
+			auto src = createImage(sub.size, from);
+			auto expectedData = img.data;
+			ny::convertFormat(src.image, sub);
+
+			for(auto y = 0u; y < sub.size[1]; ++y) {
+				for(auto x = 0u; x < sub.size[0]; ++x) {
+					unsigned int bit;
+					auto p = pixelRef(sub, {x, y}, bit);
+					auto word = (from == format) ? wordRef(src.image, {x, y}) :
+						packRef(readRef(src.image, {x, y}), format);
+					storeWord(expectedData.data() + (p - img.data.data()), format, word, bit);
+				}
+			}
+
+			check(img.data == expectedData, "convertFormat into subImage", from, format);
+		}
+	}
+}
+
+// convertFormatDithered equals convertFormat for destinations with 8-bit channels.
+// Otherwise every channel must be rounded up or down and the average of a
+// 4x4 block of one color must be close to the exact value.
+void testDither()
+{
+	for(auto from : formats) {
+		auto img = createImage(imageSize, from);
+		auto sub = view(img);
+
+		for(auto to : formats) {
+			auto dithered = ny::convertFormatDithered(sub, to);
+			auto l = layout(to);
+			auto ditheredChannels = false;
+			for(auto c = 0u; c < 4u; ++c) {
+				ditheredChannels |= l.shifts[c] >= 0 && l.depths[c] > 1 && l.depths[c] < 8;
+			}
+
+			if(!ditheredChannels) {
+				auto converted = ny::convertFormat(sub, to);
+				auto ok = true;
+				for(auto y = 0u; y < sub.size[1]; ++y) {
+					for(auto x = 0u; x < sub.size[0]; ++x) {
+						ok &= wordRef(dithered, {x, y}) == wordRef(converted, {x, y});
+					}
+				}
+
+				check(ok, "convertFormatDithered", from, to);
+				continue;
+			}
+
+			auto ok = true;
+			for(auto y = 0u; y < sub.size[1]; ++y) {
+				for(auto x = 0u; x < sub.size[0]; ++x) {
+					auto color = readRef(sub, {x, y});
+					auto word = wordRef(dithered, {x, y});
+					for(auto c = 0u; c < 4u; ++c) {
+						if(l.shifts[c] < 0) continue;
+						auto max = (1u << l.depths[c]) - 1;
+						auto value = (word >> l.shifts[c]) & max;
+						ok &= value == color[c] * max / 255 ||
+							value == (color[c] * max + 254) / 255;
+					}
+				}
+			}
+
+			check(ok, "convertFormatDithered rounding", from, to);
+		}
+	}
+
+	// averages, with rows long enough for the vectorized paths
+	for(auto from : {ImageFormat::argb8888, ImageFormat::rgba8888, ImageFormat::bgr888}) {
+		for(auto value = 0u; value < 256u; value += 5u) {
+			auto img = createImage({16u, 4u}, from);
+			nytl::Vec4u8 color {std::uint8_t(value), std::uint8_t(255 - value),
+				std::uint8_t(value / 2), 255u};
+			ny::forEachPixel(img.image, [&](nytl::Vec4u8& c) { c = color; });
+
+			auto dithered = ny::convertFormatDithered(img.image, ImageFormat::rgb565);
+			auto l = layout(ImageFormat::rgb565);
+			for(auto bx = 0u; bx < 16u; bx += 4u) {
+				for(auto c = 0u; c < 3u; ++c) {
+					auto max = (1u << l.depths[c]) - 1;
+					auto sum = 0.0;
+					for(auto y = 0u; y < 4u; ++y) {
+						for(auto x = bx; x < bx + 4u; ++x) {
+							sum += (wordRef(dithered, {x, y}) >> l.shifts[c]) & max;
+						}
+					}
+
+					auto exact = color[c] * max / 255.0;
+					check(std::abs(sum / 16 - exact) <= 1 / 16.0 + 1e-6,
+						"convertFormatDithered average", from, ImageFormat::rgb565);
+				}
+			}
+		}
+	}
+}
+
+// Calls func(srcPos, dstPos) for every pixel of a source at the given position
+// that is inside the destination.
+template<typename F>
+void forOverlap(nytl::Vec2ui srcSize, nytl::Vec2ui dstSize, nytl::Vec2i position, F&& func)
+{
+	for(auto y = 0; y < int(srcSize[1]); ++y) {
+		for(auto x = 0; x < int(srcSize[0]); ++x) {
+			auto dx = position[0] + x;
+			auto dy = position[1] + y;
+			if(dx >= 0 && dy >= 0 && dx < int(dstSize[0]) && dy < int(dstSize[1])) {
+				func(nytl::Vec2ui {unsigned(x), unsigned(y)},
+					nytl::Vec2ui {unsigned(dx), unsigned(dy)});
+			}
+		}
+	}
+}
+
+// Premultiplied source colors with some fully transparent and opaque pixels and
+// some (invalid) colors larger than alpha to test the clamping.
+void premultipliedColors(const ny::MutableImage& img)
+{
+	for(auto y = 0u; y < img.size[1]; ++y) {
+		for(auto x = 0u; x < img.size[0]; ++x) {
+			auto color = randomColor();
+			auto mode = rng() % 8u;
+			if(mode == 0) color = {};
+			if(mode == 1) color[3] = 255u;
+			if(mode > 3) {
+				for(auto c = 0u; c < 3u; ++c) color[c] = color[c] * color[3] / 255;
+			}
+
+			unsigned int bit;
+			auto p = pixelRef(img, {x, y}, bit);
+			writeRef(p, img.format, color, bit);
+		}
+	}
+}
+
+// fill, blit and composite against a per-pixel reference, with clipping.
+void testComposite()
+{
+	const nytl::Vec2i positions[] = {{0, 0}, {-3, 2}, {5, -1}, {9, 3}, {-20, 0}, {2, 40}};
+
+	for(auto format : formats) {
+		auto img = createImage(imageSize, format);
+		auto dst = view(img);
+
+		// fill
+		const nytl::Rect2ui rects[] = {{{0u, 0u}, dst.size}, {{2u, 1u}, {5u, 2u}},
+			{{7u, 3u}, {100u, 100u}}, {{50u, 0u}, {2u, 2u}}};
+		for(auto rect : rects) {
+			auto color = randomColor();
+			auto expected = img;
+			expected.image.data = expected.data.data();
+			auto expectedDst = view(expected);
+			auto pos = nytl::Vec2i {int(rect.position[0]), int(rect.position[1])};
+			forOverlap(rect.size, dst.size, pos, [&](nytl::Vec2ui, nytl::Vec2ui d) {
+				unsigned int bit;
+				auto p = pixelRef(expectedDst, d, bit);
+				writeRef(p, format, color, bit);
+			});
+
+			ny::fill(dst, rect, color);
+			check(img.data == expected.data, "fill", format);
+		}
+
+		for(auto from : formats) {
+			auto srcImg = createImage({21u, 6u}, from); // wide enough for the vectorized paths
+			auto src = view(srcImg);
+			auto srcAlpha = layout(from).shifts[3] >= 0;
+			if(srcAlpha) premultipliedColors(src);
+
+			for(auto position : positions) {
+				// blit: converted source pixels, see testConvert
+				auto expected = img;
+				expected.image.data = expected.data.data();
+				auto expectedDst = view(expected);
+				forOverlap(src.size, dst.size, position, [&](nytl::Vec2ui s, nytl::Vec2ui d) {
+					unsigned int bit;
+					auto p = pixelRef(expectedDst, d, bit);
+					auto word = (from == format) ? wordRef(src, s) :
+						packRef(readRef(src, s), format);
+					storeWord(p, format, word, bit);
+				});
+
+				auto blitted = img;
+				blitted.image.data = blitted.data.data();
+				ny::blit(src, view(blitted), position);
+				check(blitted.data == expected.data, "blit", from, format);
+
+				auto sourced = img;
+				sourced.image.data = sourced.data.data();
+				ny::composite(src, view(sourced), position, ny::CompositeOp::source);
+				check(sourced.data == expected.data, "composite source", from, format);
+
+				// over: src + dst * (255 - srcAlpha) / 255, rounded and clamped.
+				// Sources without alpha are opaque, i.e. the same as blit.
+				if(srcAlpha) {
+					expected.data = img.data;
+					auto over = [&](nytl::Vec2ui s, nytl::Vec2ui d) {
+						unsigned int bit;
+						auto p = pixelRef(expectedDst, d, bit);
+						auto sc = readRef(src, s);
+						auto dc = readRef(p, format, bit);
+						nytl::Vec4u8 color;
+						for(auto c = 0u; c < 4u; ++c) {
+							auto value = sc[c] + std::lround(dc[c] * (255 - sc[3]) / 255.0);
+							color[c] = std::min<long>(value, 255);
+						}
+
+						writeRef(p, format, color, bit);
+					};
+
+					forOverlap(src.size, dst.size, position, over);
+				}
+
+				auto composited = img;
+				composited.image.data = composited.data.data();
+				ny::composite(src, view(composited), position, ny::CompositeOp::over);
+				check(composited.data == expected.data, "composite over", from, format);
+			}
+		}
+	}
+}
+
+// Allocator that counts the allocations and checks the sizes passed to free.
+class CountingAllocator : public ny::ImageAllocator {
+public:
+	std::uint8_t* allocate(std::size_t size) override {
+		++allocations;
+		allocated += size;
+		return static_cast<std::uint8_t*>(::operator new(size,
+			std::align_val_t(ny::imageDataAlign)));
+	}
+
+	void free(std::uint8_t* data, std::size_t size) override {
+		++frees;
+		allocated -= size;
+		::operator delete(data, std::align_val_t(ny::imageDataAlign));
+	}
+
+	unsigned int allocations {};
+	unsigned int frees {};
+	std::size_t allocated {};
+};
+
+// The default allocator returns aligned, reused blocks and new images use the
+// allocator set with imageAllocator.
+void testAllocator()
+{
+	auto aligned = [](const std::uint8_t* data) {
+		return reinterpret_cast<std::uintptr_t>(data) % ny::imageDataAlign == 0;
+	};
+
+	for(auto size : {1u, 63u, 64u, 1000u, 4096u, 5u << 20}) {
+		auto data = ny::allocateImageData(size);
+		std::memset(data.get(), 0xFF, size);
+		auto ok = aligned(data.get()) && data.get_deleter().size == size &&
+			data.get_deleter().allocator == &ny::imageAllocator();
+		check(ok, "allocateImageData", ImageFormat::none);
+	}
+
+	// freed blocks of the same size class are reused
+	auto data = ny::allocateImageData(1000u);
+	auto ptr = data.get();
+	data.reset();
+	data = ny::allocateImageData(900u);
+	check(data.get() == ptr, "allocateImageData reuse", ImageFormat::none);
+
+	auto img = createImage(imageSize, ImageFormat::rgba8888);
+	auto converted = ny::convertFormat(img.image, ImageFormat::argb8888, 8 * ny::imageDataAlign);
+	auto ok = aligned(converted.data.get());
+	for(auto y = 0u; y < converted.size[1]; ++y) {
+		ok &= aligned(converted.data.get() + y * ny::bitStride(converted) / 8);
+	}
+	check(ok, "convertFormat row alignment", ImageFormat::argb8888);
+
+	// custom allocator, previously allocated data is freed with the old one
+	CountingAllocator counting;
+	ny::imageAllocator(&counting);
+	auto counted = ny::convertFormat(img.image, ImageFormat::bgra8888);
+	ny::UniqueImage copy = counted;
+	ny::UniqueImage mutableCopy = ny::MutableImage(img.image);
+	check(counting.allocations == 3 && counted.data.get_deleter().allocator == &counting,
+		"imageAllocator", ImageFormat::none);
+
+	ny::imageAllocator(nullptr);
+	check(&ny::imageAllocator() != &counting, "imageAllocator reset", ImageFormat::none);
+	converted = {};
+	counted = {};
+	copy = {};
+	mutableCopy = {};
+	check(counting.frees == 3 && counting.allocated == 0, "imageAllocator free",
+		ImageFormat::none);
+
+	// data without allocator is deleted with delete[]
+	copy.data = std::make_unique<std::uint8_t[]>(16u);
+	copy = {};
+}
+
+// The multithreaded overloads must give the same result as the single-threaded ones.
+// The image is large enough to be split up, its odd height gives bands of
+// different sizes.
+void testThreads()
+{
+	constexpr nytl::Vec2ui size {601u, 513u};
+	const std::pair<ImageFormat, ImageFormat> conversions[] = {
+		{ImageFormat::rgba8888, ImageFormat::argb8888},
+		{ImageFormat::bgra8888, ImageFormat::rgb888},
+		{ImageFormat::rgb888, ImageFormat::xrgb8888},
+		{ImageFormat::argb8888, ImageFormat::rgb565},
+		{ImageFormat::rgba16f, ImageFormat::abgr8888},
+		{ImageFormat::rgba8888, ImageFormat::a8},
+		{ImageFormat::a8, ImageFormat::a1}, // rows not byte-aligned, never split
+	};
+
+	for(auto [from, to] : conversions) {
+		auto img = createImage(size, from);
+		for(auto align : {0u, 32u}) {
+			auto expected = ny::convertFormat(img.image, to, align);
+			auto bytes = ny::dataSize(expected);
+
+			// converted into prefilled memory, rows that are skipped would remain.
+			// Only the pixels are compared, the row padding is not written
+			for(auto threads : {1u, 2u, 3u, 0u}) {
+				std::vector<std::uint8_t> data(bytes, 0xCDu);
+				ny::convertFormat(img.image, to, *data.data(), align, threads);
+				auto converted = ny::Image(data.data(), size, to, expected.stride);
+
+				auto ok = true;
+				for(auto y = 0u; y < size[1]; ++y) {
+					for(auto x = 0u; x < size[0]; ++x) {
+						ok &= wordRef(converted, {x, y}) == wordRef(expected, {x, y});
+					}
+				}
+
+				check(ok, "convertFormat threaded", from, to);
+			}
+
+			auto converted = ny::convertFormat(img.image, to, align, 3u);
+			check(converted.stride == expected.stride && converted.size == size,
+				"convertFormat threaded stride", from, to);
+		}
+	}
+
+	for(auto format : {ImageFormat::argb8888, ImageFormat::rgba8888, ImageFormat::rgba16f}) {
+		auto img = createImage(size, format);
+		auto expected = img.data;
+		ny::premultiply({expected.data(), size, format, img.image.stride});
+
+		for(auto threads : {1u, 2u, 3u, 0u}) {
+			auto data = img.data;
+			ny::premultiply({data.data(), size, format, img.image.stride}, false, threads);
+			check(data == expected, "premultiply threaded", format);
+		}
+	}
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testPixels();
+	testForEachPixel();
+	testSubImage();
+	testConvert();
+	testConvertInPlace();
+	testDither();
+	testPremultiply();
+	testThreads();
+	testComposite();
+	testAllocator();
+
+	if(failures) {
+		std::printf("%u checks failed\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
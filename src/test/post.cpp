@@ -0,0 +1,195 @@
+// Copyright (c) 2015-2018 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <ny/appContext.hpp> // ny::AppContext
+#include <ny/windowContext.hpp> // ny::WindowContext
+
+#include <atomic> // std::atomic
+#include <chrono> // std::chrono::seconds
+#include <condition_variable> // std::condition_variable
+#include <cstdio> // std::printf
+#include <mutex> // std::mutex
+#include <stdexcept> // std::runtime_error
+#include <thread> // std::thread
+#include <vector> // std::vector
+
+// Stress test for AppContext::post. Does not need a display server.
+// Producer threads post numbered tasks while the main thread dispatches them
+// with waitEvents and pollEvents, like an application event loop.
+// Returns a non-zero value if any of the checks failed.
+
+namespace {
+
+unsigned int failures {};
+
+void check(bool ok, const char* what)
+{
+	if(!ok) {
+		++failures;
+		std::printf("failed: %s\n", what);
+	}
+}
+
+// AppContext without a display connection. waitEvents blocks until
+// wakeupWait is called (or the timeout is reached), like the backends.
+class TestAppContext : public ny::AppContext {
+public:
+	static constexpr auto timeout = std::chrono::seconds(5);
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool wakeup {};
+	std::atomic<unsigned int> wakeups {};
+	unsigned int timeouts {};
+
+public:
+	ny::WindowContextPtr createWindowContext(const ny::WindowSettings&) override { return {}; }
+	ny::MouseContext* mouseContext() override { return nullptr; }
+	ny::KeyboardContext* keyboardContext() override { return nullptr; }
+
+	bool pollEvents() override {
+		dispatchPosted();
+		return true;
+	}
+
+	bool waitEvents() override {
+		{
+			std::unique_lock lock(mutex);
+			if(!cv.wait_for(lock, timeout, [&]{ return wakeup; })) {
+				++timeouts;
+			}
+
+			wakeup = false;
+		}
+
+		dispatchPosted();
+		return true;
+	}
+
+	void wakeupWait() override {
+		++wakeups;
+		{
+			std::lock_guard lock(mutex);
+			wakeup = true;
+		}
+
+		cv.notify_one();
+	}
+
+	bool clipboard(std::unique_ptr<ny::DataSource>&&) override { return false; }
+	ny::DataOffer* clipboard() override { return nullptr; }
+	bool startDragDrop(std::unique_ptr<ny::DataSource>&&) override { return false; }
+	std::vector<const char*> vulkanExtensions() const override { return {}; }
+	ny::GlSetup* glSetup() const override { return nullptr; }
+};
+
+// Tasks posted in a burst only wake up the loop once, they are called in order.
+// A throwing task does not lose the tasks posted after it.
+void testOrder()
+{
+	TestAppContext ac;
+	std::vector<unsigned int> called;
+	for(auto i = 0u; i < 10u; ++i) {
+		ac.post([&called, i]{
+			called.push_back(i);
+			if(i == 4) throw std::runtime_error("task 4");
+		});
+	}
+
+	check(ac.wakeups == 1, "one wakeup for a burst");
+
+	auto thrown = false;
+	try {
+		ac.pollEvents();
+	} catch(const std::runtime_error&) {
+		thrown = true;
+	}
+
+	check(thrown && called.size() == 5, "throwing task");
+
+	ac.post([&called]{ called.push_back(10); });
+	ac.pollEvents();
+
+	auto ordered = called.size() == 11u;
+	for(auto i = 0u; ordered && i < called.size(); ++i) {
+		ordered = called[i] == i;
+	}
+
+	check(ordered, "order of posted tasks");
+}
+
+void testStress()
+{
+	constexpr auto producerCount = 8u;
+	constexpr auto taskCount = 20000u; // per producer
+
+	TestAppContext ac;
+	auto mainThread = std::this_thread::get_id();
+
+	// only accessed from the dispatching thread
+	std::vector<unsigned int> next(producerCount);
+	auto executed = 0u;
+	auto ordered = true;
+	auto onMainThread = true;
+
+	std::vector<std::thread> producers;
+	for(auto p = 0u; p < producerCount; ++p) {
+		producers.emplace_back([&, p]{
+			for(auto i = 0u; i < taskCount; ++i) {
+				ac.post([&, p, i]{
+					ordered &= (next[p]++ == i);
+					onMainThread &= (std::this_thread::get_id() == mainThread);
+					++executed;
+				});
+
+				if(i % 1000 == 0) std::this_thread::yield();
+			}
+		});
+	}
+
+	// dispatch until every task ran. A lost wakeup would block waitEvents
+	// until its timeout although there are tasks left
+	auto iteration = 0u;
+	while(executed < producerCount * taskCount && !ac.timeouts) {
+		if(++iteration % 3 == 0) ac.pollEvents();
+		else ac.waitEvents();
+	}
+
+	for(auto& producer : producers) {
+		producer.join();
+	}
+
+	check(!ac.timeouts, "no lost wakeups");
+	check(executed == producerCount * taskCount, "all tasks executed");
+	check(ordered, "tasks of one producer executed in order");
+	check(onMainThread, "tasks executed on the dispatching thread");
+
+	// nothing must be left in the queue
+	ac.pollEvents();
+	check(executed == producerCount * taskCount, "no tasks left");
+
+	auto wakeups = ac.wakeups.load();
+	check(wakeups >= 1 && wakeups <= producerCount * taskCount, "wakeup count");
+
+	// a task posted now wakes up the loop again
+	ac.post([&]{ ++executed; });
+	ac.waitEvents();
+	check(ac.wakeups == wakeups + 1 && executed == producerCount * taskCount + 1 &&
+		!ac.timeouts, "wakeup after the queue was emptied");
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testOrder();
+	testStress();
+
+	if(failures) {
+		std::printf("%u checks failed\n", failures);
+		return 1;
+	}
+
+	return 0;
+}